@@ -52,6 +52,14 @@ Group 12
 #include <bitset>
 #include <utility>
 #include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <climits>
+#include <cstdint>
 
 // macros for gate types
 #define GATE_PI 0
@@ -71,11 +79,37 @@ Group 12
 #define LOGIC_DBAR 3
 #define LOGIC_UNSET 4
 
+// macros for test generation results
+#define ATPG_DETECTED 0
+#define ATPG_UNTESTABLE 1
+#define ATPG_ABORTED 2
+
 // macros for fault types
 #define NOFAULT   -1
 #define FAULT_SA0 0
 #define FAULT_SA1 1
 
+// fault universe: fault id 2*indx + stuck value for every node, with a status byte per id
+#define FAULT_ID(indx, stuck) (2 * (indx) + (stuck))
+#define FAULT_NODE(id) ((id) >> 1)
+#define FAULT_STUCK(id) ((id) & 1)
+#define FAULT_UNDETECTED 0
+#define FAULT_DETECTED 1
+#define FAULT_UNTESTABLE 2
+#define FAULT_ABORTED 3
+#define FAULT_EQUIVALENT 4
+
+/* defaults of the ATPG search settings */
+#define ATPG_BACKTRACK_LIMIT 10000
+#define DALG_LEARN_DEPTH 1
+#define ATPG_TIME_LIMIT 0
+#define ATPG_COMPACT_TRIES 32
+#define SAT_CONFLICT_LIMIT 100000
+#define ATPG_COMPACT_BACKTRACKS 100
+
+// upper bound of the SCOAP measures (keeps the sums from overflowing)
+#define SCOAP_MAX 100000000
+
 using namespace std;
 //using clock = std::chrono::system_clock;
 using sec = std::chrono::duration<double>; 
@@ -87,7 +121,7 @@ using ms = std::chrono::duration<double, std::milli>;
 #define Upcase(x) ((isalpha(x) && islower(x))? toupper(x) : (x))
 #define Lowcase(x) ((isalpha(x) && isupper(x))? tolower(x) : (x))
 
-enum e_com {READ, PC, HELP, QUIT, LEV, LOGICSIM, RFL, PFS, RTG, DFS, PODEM, DALG, ATPG_DET, ATPG};
+enum e_com {READ, PC, HELP, QUIT, LEV, LOGICSIM, RFL, PFS, RTG, DFS, PODEM, DALG, FAN, SAT, ATPG_DET, ATPG, COMPACT, COLLAPSE, CACHE, RESUME};
 enum e_state {EXEC, CKTLD};         /* Gstate values */
 enum e_ntype {GATE, PI, FB, PO};    /* column 1 of circuit format */
 enum e_gtype {IPT, BRCH, XOR, OR, NOR, NOT, NAND, AND};  /* gate types */
@@ -98,6 +132,12 @@ struct cmdstruc {
    enum e_state state;        /* execution state sequence */
 };
 
+/* dual-rail bit-parallel five-valued word: bit k of every plane belongs to lane k */
+struct drword {
+   uint64_t g, gv;            /* good-machine values and their validity (known) mask */
+   uint64_t f, fv;            /* faulty-machine values and their validity mask */
+};
+
 typedef struct n_struc {
    unsigned indx;             /* node index(from 0 to NumOfLine - 1 */
    unsigned num;              /* line number(May be different from indx */
@@ -107,21 +147,123 @@ typedef struct n_struc {
    struct n_struc **unodes;   /* pointer to array of up nodes */
    struct n_struc **dnodes;   /* pointer to array of down nodes */
    int level;                   /* level of the gate output */
-   int value;                 /* value of the gate output */
-   int f_value;
-   int fault;                 /* logic value of the fault */
-   int level_not_assign;
-   int sa_parent[2];
-   int assign_level;
+   int cc0, cc1;              /* SCOAP 0/1-controllability */
+   int co;                    /* SCOAP observability */
+   int po;                    /* 1 if the node is a primary output */
+   int headline;              /* 1 if the node is the output of a fanout-free region (FAN) */
+   struct n_struc *idom;      /* immediate dominator towards the primary outputs, NULL if none */
+   int domDepth;              /* depth of the node in the dominator tree */
 } NSTRUC;                     
 
+/* what READ builds: the nodes, their levels, SCOAP measures, headlines and
+   dominators, and the static learning; test generation only reads it */
+struct Circuit {
+   NSTRUC *node;
+   NSTRUC **pi, **po;
+   int nnodes, npi, npo;
+   int maxLevel;              /* highest level assigned by lev() */
+   const int *learnStart;     /* static learning: row offsets per literal 2*indx+value */
+   const int *learnTarget;    /* static learning: implied literals */
+};
+
+/* search values of one node, kept by a SearchState */
+struct NodeState {
+   int value = LOGIC_X;       /* value of the gate output */
+   int f_value = 0;           /* DFS: value of the output with the fault */
+   int fault = NOFAULT;       /* logic value of the fault */
+   int assign_level = -1;     /* DALG level that assigned the value, -1 if unassigned */
+   int inqueue = 0;           /* set while the node waits in the DALG implication queue */
+   int dfront = 0;            /* set while the node is a DALG D-frontier candidate */
+   int tpos = 0;              /* position of the node's entry on the DALG trail */
+   int rkind = 0, rnode = 0;  /* DALG reason: DALG_R_* and the node index it refers to */
+   int whystamp = 0;          /* DALG conflict analysis that last visited the node */
+   int queued = 0;            /* set while the node waits in the PODEM event queue */
+   int dfpos = -1;            /* position in dFrontier, -1 if not on the D frontier */
+   int xstamp = 0;            /* X-path check that last visited the node */
+   int xpath = 0;             /* result of that visit */
+   drword dr = drword();      /* value in the current speculative PODEM pass */
+   int drstamp = 0;           /* speculative pass that last set dr */
+   int fcone = 0;             /* equal to coneStamp inside the fanout cone of the current fault */
+   int mb0 = 0, mb1 = 0;      /* FAN multiple backtrace: objective counts for 0 and 1 */
+   int mbstamp = 0;           /* multiple backtrace that last set mb0/mb1 */
+};
+
+/* search settings of one command; they start from the defaults */
+struct AtpgSettings {
+   int backtracks = ATPG_BACKTRACK_LIMIT;        /* backtracks allowed per fault before it is aborted */
+   double seconds = ATPG_TIME_LIMIT;             /* optional wall-clock budget per fault in seconds (0 = none) */
+   int depth = DALG_LEARN_DEPTH;                 /* recursive learning depth in DALG implication (0 = off) */
+   int satConflicts = SAT_CONFLICT_LIMIT;        /* conflicts allowed per fault before SAT ATPG aborts */
+   int compactTries = ATPG_COMPACT_TRIES;        /* secondary faults tried per pattern by dynamic compaction (0 = off) */
+   int compactBacktracks = ATPG_COMPACT_BACKTRACKS;   /* backtracks allowed per secondary fault */
+};
+
+/* DALG assignment trail entry, see dalgAssign */
+struct dalgTrailEntry {
+   int indx;
+   int value;
+   int level;
+};
+
+/* Everything a test generation engine writes while it searches one fault:
+   the node values, the frontiers, trails and queues, and the visit stamps.
+   Every thread that generates tests owns one; the circuit is shared. */
+struct SearchState {
+   const Circuit &C;
+   AtpgSettings settings;     /* limits of the searches */
+   vector<NodeState> node;    /* by node index */
+   NodeState &operator[](const NSTRUC *g) { return node[g->indx]; }
+
+   NSTRUC *faultLocation = NULL;
+   int faultActivationVal = LOGIC_X;
+
+   // PODEM and FAN
+   std::chrono::steady_clock::time_point podem_tStart;
+   vector<NSTRUC *> dFrontier;
+   vector<vector<NSTRUC *> > eventQueue;      // per-level buckets of gates waiting to be evaluated
+   vector<pair<NSTRUC *, int> > podemTrail;   // (node, previous value) of every value change, for undo
+   int xPathStamp = 0;                        // incremented for every X-path check
+   int drStamp = 0;                           // incremented for every speculative pass
+   int coneStamp = 0;                         // incremented for every fault cone marked
+   vector<pair<NSTRUC *, int> > sensitizeObj; // unique sensitization objectives of the current state
+   vector<vector<NSTRUC *> > mbQueue;         // per-level buckets of the multiple backtrace
+   int mbStamp = 0;                           // incremented for every multiple backtrace
+
+   // set while the engine races others on the same fault (PORTFOLIO);
+   // the race sets the flag once some engine has finished the fault
+   const atomic<bool> *atpgCancel = NULL;
+   // backtrack limit of the searches when >= 0, instead of settings.backtracks
+   int atpgBacktrackCap = -1;
+
+   // DALG
+   vector<int> Dfront;                        // D-frontier candidates, filtered by check_Dfront when read
+   vector<int> imply;                         // decisions waiting for the next implication pass
+   vector<int> dalgQueue;                     // implication worklist
+   int Dalg_count = 0;                        // backtracks made for the current fault
+   bool dalgAborted = false;                  // set when the current fault ran out of budget
+   std::chrono::steady_clock::time_point dalg_tStart;
+   vector<NSTRUC *> dalgConflictSeeds;        // nodes of the last implication conflict
+   bool dalgConflictAll = false;              // the last conflict depends on every level
+   vector<char> dalgWhy;                      // decision levels responsible for the last failure
+   int dalgWhyStamp = 0;
+   vector<dalgTrailEntry> dalgTrail;
+   vector<int> dalgTrailLim;
+   vector<int> dalgDfrontLim;
+
+   SearchState(const Circuit &c, const AtpgSettings &s = AtpgSettings())
+      : C(c), settings(s), node(c.nnodes), eventQueue(c.maxLevel + 1), mbQueue(c.maxLevel + 1) {}
+};
+
 /*----------------- Command definitions ----------------------------------*/
-#define NUMFUNCS 14
-int cread(char *cp), pc(char *cp), help(char *cp), quit(char *cp), level(char *cp), logicsim(char *cp), rfl(char *cp), pfs(char *cp), rtg(char *cp), dfs(char *cp), podem(char *cp), dalg(char *cp), atpg_det(char *cp), atpg(char *cp);
-void allocate(), clear();
+#define NUMFUNCS 20
+int cread(char *cp), pc(char *cp), help(char *cp), quit(char *cp), level(char *cp), logicsim(char *cp), rfl(char *cp), pfs(char *cp), rtg(char *cp), dfs(char *cp), podem(char *cp), dalg(char *cp), fan(char *cp), sat(char *cp), atpg_det(char *cp), atpg(char *cp), compact(char *cp), collapsecmd(char *cp), cache(char *cp), resume(char *cp);
+void allocate(), clear(), lev(), scoap(), learn(), headlines(), dominators(), collapse();
+vector<int> collapseFaults(const vector<int> &ids);
+vector<int> expandFaultStatus(const vector<int> &ids);
+bool readFaultList(const char *file, vector<int> &ids), writeFaultList(const char *file, const vector<int> &ids);
+int simGate(SearchState &S, NSTRUC* g), controllingValue(NSTRUC* g);
 string gname(int tp);
 struct cmdstruc command[NUMFUNCS] = {
-   {"ATPG_DET", atpg_det, EXEC},
    {"READ", cread, EXEC},
    {"PC", pc, CKTLD},
    {"HELP", help, EXEC},
@@ -134,7 +276,14 @@ struct cmdstruc command[NUMFUNCS] = {
    {"DFS", dfs, CKTLD},
    {"PODEM", podem, CKTLD},
    {"DALG", dalg, CKTLD},
+   {"FAN", fan, CKTLD},
+   {"SAT", sat, CKTLD},
+   {"ATPG_DET", atpg_det, EXEC},
    {"ATPG", atpg, EXEC},
+   {"COMPACT", compact, CKTLD},
+   {"COLLAPSE", collapsecmd, CKTLD},
+   {"CACHE", cache, EXEC},
+   {"RESUME", resume, EXEC},
 };
 
 /*------------------------------------------------------------------------*/
@@ -147,11 +296,18 @@ int Npi;                        /* number of primary inputs */
 int Npo;                        /* number of primary outputs */
 int Done = 0;                   /* status bit to terminate program */
 vector<int> node_queue;
-vector<NSTRUC *> dFrontier;
-NSTRUC* faultLocation;
-int faultActivationVal;
 int podem_count = 0;
+int maxLevel;                   /* highest level assigned by lev() */
+vector<int> learnStart;         /* static learning: row offsets per literal 2*indx+value */
+vector<int> learnTarget;        /* static learning: implied literals */
+Circuit circuit;                /* the circuit read last, as the test generators see it */
 string circuitName;
+vector<int> indxOfNum;          /* node index of every node number, -1 if there is no such node */
+vector<unsigned char> faultStatus;   /* FAULT_* status of every fault, by fault id */
+vector<int> faultRep;           /* collapsed fault list: fault targeted in place of every fault id */
+vector<char> faultDominated;    /* 1 if a fault reaches its representative through a dominance */
+vector<int> faultMemberStart;   /* row offsets of the members of every representative */
+vector<int> faultMembers;       /* members of the representatives, grouped by representative */
 /*------------------------------------------------------------------------*/
 
 /*-----------------------------------------------------------------------
@@ -185,9 +341,9 @@ main()
 	cp++;
       }
       cp = cline + strlen(wstr);
-      com = READ;
       com_int = 0;
-      while(com_int < NUMFUNCS && strcmp(wstr, command[com].name)) com = static_cast<e_com>(com_int++);
+      while(com_int < NUMFUNCS && strcmp(wstr, command[com_int].name)) com_int++;
+      com = static_cast<e_com>(com_int);
       if(com < NUMFUNCS) {
          if(command[com].state <= Gstate) (*command[com].fptr)(cp);
          else printf("Execution out of sequence!\n");
@@ -217,7 +373,7 @@ description:
 int cread(char *cp)
 {
    char buf[MAXLINE];
-   int ntbl, *tbl, i, j, k, nd, tp, fo, fi, ni = 0, no = 0;
+   int ntbl, i, j, k, nd, tp, fo, fi, ni = 0, no = 0;
    FILE *fd;
    NSTRUC *np;
 
@@ -249,22 +405,24 @@ int cread(char *cp)
          else if(tp == PO) Npo++;
       }
    }
-   tbl = (int *) malloc(++ntbl * sizeof(int));
+   indxOfNum.assign(++ntbl, -1);
 
    fseek(fd, 0L, 0);
    i = 0;
    while(fgets(buf, MAXLINE, fd) != NULL) {
-      if(sscanf(buf,"%d %d", &tp, &nd) == 2) tbl[nd] = i++;
+      if(sscanf(buf,"%d %d", &tp, &nd) == 2) indxOfNum[nd] = i++;
    }
    allocate();
 
    fseek(fd, 0L, 0);
    while(fscanf(fd, "%d %d", &tp, &nd) != EOF) {
-      np = &Node[tbl[nd]];
+      np = &Node[indxOfNum[nd]];
       np->num = nd;
-      np->value = -1;
       if(tp == PI) Pinput[ni++] = np;
-      else if(tp == PO) Poutput[no++] = np;
+      else if(tp == PO) {
+         Poutput[no++] = np;
+         np->po = 1;
+      }
       switch(tp) {
          case PI:
          case PO:
@@ -285,7 +443,7 @@ int cread(char *cp)
       np->dnodes = (NSTRUC **) malloc(np->fout * sizeof(NSTRUC *));
       for(i = 0; i < np->fin; i++) {
          fscanf(fd, "%d", &nd);
-         np->unodes[i] = &Node[tbl[nd]];
+         np->unodes[i] = &Node[indxOfNum[nd]];
          }
       for(i = 0; i < np->fout; np->dnodes[i++] = NULL);
       }
@@ -298,6 +456,29 @@ int cread(char *cp)
          }
       }
    fclose(fd);
+
+   // levelize once so that the event-driven PODEM implication can schedule by level,
+   // compute the SCOAP measures used by PODEM and DALG to order their choices,
+   // learn the static implications both of them consult, and find the
+   // headlines and dominators used by FAN, and collapse the fault universe
+   lev();
+   scoap();
+   learn();
+   headlines();
+   dominators();
+   collapse();
+   node_queue.clear();
+   faultStatus.assign(2 * Nnodes, FAULT_UNDETECTED);
+   circuit.node = Node;
+   circuit.pi = Pinput;
+   circuit.po = Poutput;
+   circuit.nnodes = Nnodes;
+   circuit.npi = Npi;
+   circuit.npo = Npo;
+   circuit.maxLevel = maxLevel;
+   circuit.learnStart = learnStart.data();
+   circuit.learnTarget = learnTarget.data();
+   
    Gstate = CKTLD;
    printf("==> OK\n");
 
@@ -341,14 +522,14 @@ int pc(char *cp)
 }
 
 /*-----------------------------------------------------------------------
-input: output_values (initial - may be empty), also uses the node_queue
+input: node values, output_values (initial - may be empty), also uses the node_queue
 output: output_values (after evaluation)
 called by: logicsim
 description:
   Event-Driven Simulation
   The routine evaluates the circuit and returns the PO values for the updated PI values.
 -----------------------------------------------------------------------*/
-map<int,int> eval_gates (map<int,int> &output_values) {
+map<int,int> eval_gates (SearchState &S, map<int,int> &output_values) {
 
    int i, j, old_value;
    NSTRUC *np;
@@ -356,95 +537,27 @@ map<int,int> eval_gates (map<int,int> &output_values) {
    //now, go through the elements in the node_queue and evaluate
    while(node_queue.size() > 0) {
       np = &Node[node_queue[0]];    // read the node data
-      old_value = np->value;     // save old value (to be compared with evaluated value to determine if the value has changed)
+      old_value = S[np].value;     // save old value (to be compared with evaluated value to determine if the value has changed)
       switch(np->type) {
          case 0:  // PI
             for (i = 0; i < np->fout; i++) {
                   node_queue.push_back(np->dnodes[i]->indx); // add downstream elements to the queue
                }
             break;      
-         case 1:  // BRANCH
-            np->value = np->unodes[0]->value;
-            break;
-         case 2:  // XOR
-            np->value = np->unodes[0]->value; 
-            for (j = 1; j < np->fin; j++) {
-               if (np->value == -1 || np->unodes[j]->value == -1) {
-                  np->value = -1;
-                  break;
-               }
-               else {
-                  np->value = np->value ^ np->unodes[j]->value;
-               }
-            }
-            break; 
-         case 3:  // OR
-            np->value = 0;  
-            for (j = 0; j < np->fin; j++) {
-               if (np->unodes[j]->value == 1) {
-                  np->value = 1;
-                  break;
-               }
-               else if (np->unodes[j]->value == -1) {
-                  np->value = -1;
-               }
-            } 
+         default:  // gates: evaluate with the shared five-valued tables (0/1/X subset)
+            S[np].value = simGate(S, np);
             break;
-         case 4:  // NOR
-            np->value = 1;    
-            for (j = 0; j < np->fin; j++) {
-               if (np->unodes[j]->value == 1) {
-                  np->value = 0;
-                  break;
-               }
-               else if (np->unodes[j]->value == -1) {
-                  np->value = -1;
-               }
-            }
-            break; 
-         case 5: // NOT
-            if (np->unodes[0]->value == -1) {
-               np->value = -1;
-            }
-            else {
-               np->value = !(np->unodes[0]->value); 
-            }
-            break; 
-         case 6:  // NAND
-            np->value = 0;    
-            for (j = 0; j < np->fin; j++) {
-               if (np->unodes[j]->value == 0) {
-                  np->value = 1;
-                  break;
-               }
-               else if (np->unodes[j]->value == -1) {
-                  np-> value = -1;
-               }
-            }
-            break; 
-         case 7:  // AND
-            np->value = 1;    
-            for (j = 0; j < np->fin; j++) {
-               if (np->unodes[j]->value == 0) {
-                  np->value = 0;
-                  break;
-               }
-               else if (np->unodes[j]->value == -1) {
-                  np-> value = -1;
-               }
-            }
-            break; 
       }
 
       node_queue.erase(node_queue.begin());  // remove the first element as it has been evaluated
-      if (old_value != np->value || old_value == -1) {
+      if (old_value != S[np].value || old_value == -1) {
          for (i = 0; i < np->fout; i++) {
             node_queue.push_back(np->dnodes[i]->indx); // add downstream elements to the queue
          }
       }
 
       if (np->fout == 0) {
-         output_values[np->num] = np->value;    // modify the updated PO value
+         output_values[np->num] = S[np].value;    // modify the updated PO value
       }
    }
 
@@ -488,6 +601,7 @@ int logicsim(char *cp)
    }
 
    map<int, int> output_values;     // dictionary to hold PO values
+   SearchState S(circuit);          // node values, all unknown (-1) at first
 
    ofstream output_file;
    output_file.open(out_buf);
@@ -501,7 +615,7 @@ int logicsim(char *cp)
          for (j = 0; j < Nnodes; j++){    // iterate over all the nodes
             if (Node[j].num == input_patterns[0][i]) {
                // cout << "Previous value of PI is " << input_patterns[k-1][i] << " - New value is " << input_patterns[k][i] << endl;
-               Node[j].value = input_patterns[k][i];
+               S.node[j].value = input_patterns[k][i];
                if (k == 1) {
                   node_queue.push_back(j);
                   // cout << Node[j].num << endl;
@@ -515,7 +629,7 @@ int logicsim(char *cp)
          }
       }
 
-      output_values = eval_gates(output_values);      // function call to evaluate the circuit
+      output_values = eval_gates(S, output_values);      // function call to evaluate the circuit
 
       // print outputs
       // for( map<int, int>::iterator i= output_values.begin(); i != output_values.end(); i++)
@@ -571,30 +685,20 @@ int rfl(char *cp)
    char out_buf[MAXLINE];
    sscanf(cp, "%s", out_buf);
 
-   vector<pair<int, int> > fault_list;     // dictionary to hold PO values
-   pair<int,int> fault;    // temporarily holds the faults
-
-   ofstream output_file;
-   output_file.open(out_buf);
+   vector<int> fault_list;     // fault ids
 
    // checkpoint theorem
    for (i = 0; i < Nnodes; i++){    // iterate over all the nodes
       np = &Node[i];
       if (np->type == 0 || np->type == 1) {     // check if the node type is PI or BRANCH
-         fault.first = np->num;
          for (j = 0; j < 2; j++) {     // assign value of 0 and 1 to the faulty node
-            fault.second = j; 
-            fault_list.push_back(fault);     // add the fault to the fault_list
+            fault_list.push_back(FAULT_ID(i, j));     // add the fault to the fault_list
          }
       }
    }
 
    // write to file
-   if ( output_file ) {
-      for (i = 0; i < fault_list.size(); i++) {
-         output_file << fault_list[i].first << "@" << fault_list[i].second << endl;
-      }
-   } else {
+   if (!writeFaultList(out_buf, fault_list)) {
       cout << "Couldn't create file\n";
    }
 
@@ -615,6 +719,7 @@ void lev()
    int Nodes_done =0;
    NSTRUC *np;
    node_queue.clear();
+   maxLevel = 0;
 
    // Start with primary inputs
    for(i=0; i<Nnodes; i++){
@@ -637,6 +742,7 @@ void lev()
          if(np->level == -1) {    // Node is at an undefined level
             if((np->type == 1) && (np->unodes[0]->level != -1)) {     // Node is a branch and upstream node is not at undefined level
                np->level=np->unodes[0]->level+1;
+               if (np->level > maxLevel) maxLevel = np->level;
                node_queue.push_back(np->indx);
                Nodes_done++;				 
             }
@@ -656,6 +762,7 @@ void lev()
                }
                if (flag==1){
                   np->level=level+1;
+                  if (np->level > maxLevel) maxLevel = np->level;
                   node_queue.push_back(np->indx);
                   Nodes_done++;
                }
@@ -666,6 +773,473 @@ void lev()
 }
 
 
+/*-----------------------------------------------------------------------
+input: nothing (uses the node_queue built by lev)
+output: nothing
+called by: cread
+description:
+  The routine computes the SCOAP testability measures of every node.
+  CC0/CC1 are computed in level order starting from CC=1 on the PIs, and
+  CO is computed in reverse level order starting from CO=0 on the POs.
+  The values are cached on the nodes; they are only recomputed when a new
+  circuit is read.
+-----------------------------------------------------------------------*/
+int scoapAdd(int a, int b)
+{
+   return (a + b > SCOAP_MAX) ? SCOAP_MAX : a + b;
+}
+
+void scoap()
+{
+   int i, j, k, sum, co, c0, c1, n0, n1;
+   NSTRUC *np, *dp;
+
+   // controllability
+   for (i = 0; i < node_queue.size(); i++) {
+      np = &Node[node_queue[i]];
+      switch (np->type) {
+         case GATE_PI:
+            np->cc0 = np->cc1 = 1;
+            break;
+         case GATE_BRANCH:
+            np->cc0 = np->unodes[0]->cc0;
+            np->cc1 = np->unodes[0]->cc1;
+            break;
+         case GATE_NOT:
+            np->cc0 = scoapAdd(np->unodes[0]->cc1, 1);
+            np->cc1 = scoapAdd(np->unodes[0]->cc0, 1);
+            break;
+         case GATE_XOR:
+            c0 = np->unodes[0]->cc0;
+            c1 = np->unodes[0]->cc1;
+            for (j = 1; j < np->fin; j++) {
+               n0 = min(scoapAdd(c0, np->unodes[j]->cc0), scoapAdd(c1, np->unodes[j]->cc1));
+               n1 = min(scoapAdd(c0, np->unodes[j]->cc1), scoapAdd(c1, np->unodes[j]->cc0));
+               c0 = n0;
+               c1 = n1;
+            }
+            np->cc0 = scoapAdd(c0, 1);
+            np->cc1 = scoapAdd(c1, 1);
+            break;
+         case GATE_AND:
+         case GATE_NAND:
+            c0 = SCOAP_MAX;
+            c1 = 0;
+            for (j = 0; j < np->fin; j++) {
+               c0 = min(c0, np->unodes[j]->cc0);
+               c1 = scoapAdd(c1, np->unodes[j]->cc1);
+            }
+            np->cc0 = scoapAdd((np->type == GATE_AND) ? c0 : c1, 1);
+            np->cc1 = scoapAdd((np->type == GATE_AND) ? c1 : c0, 1);
+            break;
+         case GATE_OR:
+         case GATE_NOR:
+            c0 = 0;
+            c1 = SCOAP_MAX;
+            for (j = 0; j < np->fin; j++) {
+               c0 = scoapAdd(c0, np->unodes[j]->cc0);
+               c1 = min(c1, np->unodes[j]->cc1);
+            }
+            np->cc0 = scoapAdd((np->type == GATE_OR) ? c0 : c1, 1);
+            np->cc1 = scoapAdd((np->type == GATE_OR) ? c1 : c0, 1);
+            break;
+      }
+   }
+
+   // observability
+   for (i = 0; i < Nnodes; i++) {
+      Node[i].co = (Node[i].fout == 0) ? 0 : SCOAP_MAX;
+   }
+   for (i = 0; i < Npo; i++) {
+      Poutput[i]->co = 0;
+   }
+   for (i = node_queue.size() - 1; i >= 0; i--) {
+      np = &Node[node_queue[i]];
+      for (j = 0; j < np->fout; j++) {
+         dp = np->dnodes[j];
+         sum = 0;
+         switch (dp->type) {
+            case GATE_BRANCH:
+            case GATE_NOT:
+               break;
+            case GATE_XOR:
+               for (k = 0; k < dp->fin; k++) {
+                  if (dp->unodes[k] != np) sum = scoapAdd(sum, min(dp->unodes[k]->cc0, dp->unodes[k]->cc1));
+               }
+               break;
+            case GATE_AND:
+            case GATE_NAND:
+               for (k = 0; k < dp->fin; k++) {
+                  if (dp->unodes[k] != np) sum = scoapAdd(sum, dp->unodes[k]->cc1);
+               }
+               break;
+            case GATE_OR:
+            case GATE_NOR:
+               for (k = 0; k < dp->fin; k++) {
+                  if (dp->unodes[k] != np) sum = scoapAdd(sum, dp->unodes[k]->cc0);
+               }
+               break;
+            default:
+               break;
+         }
+         co = scoapAdd(dp->co, (dp->type == GATE_BRANCH) ? sum : scoapAdd(sum, 1));
+         if (co < np->co) np->co = co;
+      }
+   }
+}
+
+
+/*-----------------------------------------------------------------------
+input: nothing (uses the levels assigned by lev)
+output: nothing
+called by: cread
+description:
+  Static learning (SOCRATES). Every fanout stem s is set to 0 and to 1
+  in turn and the good-machine values it implies are simulated forward.
+  When s=v implies a node n=w and n=w needs all inputs of n at their
+  non-controlling value (AND=1, NAND=0, OR=0, NOR=1), the contrapositive
+  n=!w -> s=!v cannot be found by local backward implication, so it is
+  recorded. Literal (node, value) is coded as 2*indx + value and the
+  learned implications are kept in compressed rows: those of literal l
+  are learnTarget[learnStart[l] .. learnStart[l+1]).
+  The stems are split over worker threads; the result stays with the
+  circuit until the next READ.
+-----------------------------------------------------------------------*/
+int learnEval(NSTRUC *np, const vector<signed char> &val)
+{
+   int j, v, c, out;
+
+   switch (np->type) {
+      case GATE_BRANCH:
+         return val[np->unodes[0]->indx];
+      case GATE_NOT:
+         v = val[np->unodes[0]->indx];
+         return (v == LOGIC_X) ? LOGIC_X : 1 - v;
+      case GATE_XOR:
+         out = 0;
+         for (j = 0; j < np->fin; j++) {
+            v = val[np->unodes[j]->indx];
+            if (v == LOGIC_X) return LOGIC_X;
+            out ^= v;
+         }
+         return out;
+      case GATE_AND:
+      case GATE_NAND:
+      case GATE_OR:
+      case GATE_NOR:
+         c = (np->type == GATE_AND || np->type == GATE_NAND) ? LOGIC_0 : LOGIC_1;
+         out = 1 - c;
+         for (j = 0; j < np->fin; j++) {
+            v = val[np->unodes[j]->indx];
+            if (v == c) {
+               out = c;
+               break;
+            }
+            if (v == LOGIC_X) out = LOGIC_X;
+         }
+         if (out == LOGIC_X || np->type == GATE_AND || np->type == GATE_OR) return out;
+         return 1 - out;
+      default:
+         return val[np->indx];
+   }
+}
+
+/* does n=w need every input of n at its non-controlling value? */
+int learnRequiresAll(NSTRUC *np, int w)
+{
+   switch (np->type) {
+      case GATE_AND: case GATE_NOR: return w == LOGIC_1;
+      case GATE_NAND: case GATE_OR: return w == LOGIC_0;
+      default: return 0;
+   }
+}
+
+/* is n fed by stem s directly or through one of its branches? */
+int learnLocal(NSTRUC *np, NSTRUC *s)
+{
+   int j;
+
+   for (j = 0; j < np->fin; j++) {
+      if (np->unodes[j] == s || (np->unodes[j]->type == GATE_BRANCH && np->unodes[j]->unodes[0] == s)) return 1;
+   }
+   return 0;
+}
+
+/* worker: learn from stems[t], stems[t+nthreads], ...; found gets (source literal, target literal) */
+void learnStems(const vector<int> *stems, int t, int nthreads, vector<pair<int, int> > *found)
+{
+   vector<signed char> val(Nnodes, LOGIC_X);
+   vector<char> queued(Nnodes, 0);
+   vector<vector<int> > bucket(maxLevel + 1);
+   vector<int> touched;
+   int i, j, k, lvl, v, w;
+   NSTRUC *s, *np;
+
+   for (i = t; i < stems->size(); i += nthreads) {
+      s = &Node[(*stems)[i]];
+      for (v = 0; v < 2; v++) {
+         val[s->indx] = v;
+         touched.assign(1, s->indx);
+         for (j = 0; j < s->fout; j++) {
+            queued[s->dnodes[j]->indx] = 1;
+            bucket[s->dnodes[j]->level].push_back(s->dnodes[j]->indx);
+         }
+         for (lvl = s->level + 1; lvl <= maxLevel; lvl++) {
+            for (k = 0; k < bucket[lvl].size(); k++) {
+               np = &Node[bucket[lvl][k]];
+               queued[np->indx] = 0;
+               if ((w = learnEval(np, val)) == LOGIC_X) continue;
+               val[np->indx] = w;
+               touched.push_back(np->indx);
+               if (learnRequiresAll(np, w) && !learnLocal(np, s))
+                  found->push_back(make_pair(2 * np->indx + (1 - w), 2 * s->indx + (1 - v)));
+               for (j = 0; j < np->fout; j++) {
+                  if (!queued[np->dnodes[j]->indx]) {
+                     queued[np->dnodes[j]->indx] = 1;
+                     bucket[np->dnodes[j]->level].push_back(np->dnodes[j]->indx);
+                  }
+               }
+            }
+            bucket[lvl].clear();
+         }
+         for (k = 0; k < touched.size(); k++) val[touched[k]] = LOGIC_X;
+      }
+   }
+}
+
+void learn()
+{
+   vector<int> stems;
+   int i, t, nthreads;
+
+   for (i = 0; i < Nnodes; i++) {
+      if (Node[i].fout > 1) stems.push_back(i);
+   }
+
+   nthreads = thread::hardware_concurrency();
+   if (nthreads < 1) nthreads = 1;
+   if (nthreads > stems.size()) nthreads = max((int) stems.size(), 1);
+   vector<vector<pair<int, int> > > found(nthreads);
+   vector<thread> workers;
+   for (t = 1; t < nthreads; t++) workers.push_back(thread(learnStems, &stems, t, nthreads, &found[t]));
+   learnStems(&stems, 0, nthreads, &found[0]);
+   for (t = 0; t < workers.size(); t++) workers[t].join();
+
+   // compressed rows, sorted and without duplicates
+   vector<pair<int, int> > all;
+   for (t = 0; t < nthreads; t++) all.insert(all.end(), found[t].begin(), found[t].end());
+   sort(all.begin(), all.end());
+   all.erase(unique(all.begin(), all.end()), all.end());
+   learnStart.assign(2 * Nnodes + 1, 0);
+   learnTarget.resize(all.size());
+   for (i = 0; i < all.size(); i++) {
+      learnStart[all[i].first + 1]++;
+      learnTarget[i] = all[i].second;
+   }
+   for (i = 0; i < 2 * Nnodes; i++) learnStart[i + 1] += learnStart[i];
+}
+
+
+/*-----------------------------------------------------------------------
+input: nothing (uses the node_queue built by lev)
+output: nothing
+called by: cread
+description:
+  The routine marks the headlines and computes the PO-dominator tree used
+  by FAN. A line is bound if it is reachable from a fanout branch and free
+  otherwise; a headline is a free line that drives a bound line or is an
+  output, so the fanout-free cone behind it can always be justified later.
+  idom is the immediate dominator of a node towards the primary outputs
+  (NULL if the paths only meet at the outputs): every path from the node
+  to any output passes through idom, idom->idom, ...
+-----------------------------------------------------------------------*/
+NSTRUC *domIntersect(NSTRUC *a, NSTRUC *b)
+{
+   while (a != b) {
+      if (a == NULL || b == NULL) return NULL;
+      if (a->domDepth >= b->domDepth) a = a->idom;
+      else b = b->idom;
+   }
+   return a;
+}
+
+void headlines()
+{
+   int i, j;
+   NSTRUC *np;
+   vector<char> bound(Nnodes, 0);
+
+   for (i = 0; i < node_queue.size(); i++) {
+      np = &Node[node_queue[i]];
+      bound[np->indx] = (np->type == GATE_BRANCH);
+      for (j = 0; j < np->fin; j++) {
+         if (bound[np->unodes[j]->indx]) bound[np->indx] = 1;
+      }
+   }
+   for (i = 0; i < Nnodes; i++) {
+      np = &Node[i];
+      np->headline = !bound[i] && np->fout == 0;
+      for (j = 0; j < np->fout; j++) {
+         if (!bound[i] && bound[np->dnodes[j]->indx]) np->headline = 1;
+      }
+   }
+}
+
+void dominators()
+{
+   int i, j;
+   NSTRUC *np, *d;
+
+   for (i = node_queue.size() - 1; i >= 0; i--) {
+      np = &Node[node_queue[i]];
+      d = NULL;
+      if (!np->po && np->fout > 0) {
+         d = np->dnodes[0];
+         for (j = 1; j < np->fout; j++) d = domIntersect(d, np->dnodes[j]);
+      }
+      np->idom = d;
+      np->domDepth = (d == NULL) ? 1 : d->domDepth + 1;
+   }
+}
+
+
+/*-----------------------------------------------------------------------
+input: nothing (uses the node_queue built by lev)
+output: nothing
+called by: cread
+description:
+  Structural fault collapsing of the full universe (both faults on every
+  node). A gate input is a line of its own only when its driver has a
+  single fanout (otherwise it is a branch node) and is not a primary
+  output, which is observed on its own; only those inputs take part. Equivalence: input SA c == output SA c^inv for a gate with
+  controlling value c (AND/NAND SA0, OR/NOR SA1); both values for NOT,
+  single-input gates and buffers. Dominance: output SA !c^inv is detected
+  by any test for an input SA !c, so its class is dropped onto that
+  input's class. faultRep[id] is the fault that is targeted in place of
+  id (id itself for a representative), faultDominated[id] is 1 when the
+  way there passes a dominance, and the members of representative r are
+  faultMembers[faultMemberStart[r] .. faultMemberStart[r+1]).
+-----------------------------------------------------------------------*/
+int collapseFind(vector<int> &parent, int f)
+{
+   while (parent[f] != f) f = parent[f] = parent[parent[f]];
+   return f;
+}
+
+void collapse()
+{
+   int i, j, c, inv, a, b;
+   NSTRUC *np, *in;
+   int nfaults = 2 * Nnodes;
+   vector<int> parent(nfaults), domTo(nfaults, -1);
+
+   for (i = 0; i < nfaults; i++) parent[i] = i;
+
+   // equivalence classes, the smallest fault id is the root
+   for (i = 0; i < Nnodes; i++) {
+      np = &Node[i];
+      if (np->fin == 0 || np->type == GATE_XOR) continue;
+      c = controllingValue(np);
+      inv = (np->type == GATE_NOT || np->type == GATE_NAND || np->type == GATE_NOR);
+      for (j = 0; j < np->fin; j++) {
+         in = np->unodes[j];
+         if (in->fout != 1 || in->po) continue;
+         for (int v = 0; v < 2; v++) {
+            if (c != LOGIC_X && np->fin > 1 && v != c) continue;
+            a = collapseFind(parent, FAULT_ID(in->indx, v));
+            b = collapseFind(parent, FAULT_ID(np->indx, v ^ inv));
+            if (a < b) parent[b] = a;
+            else parent[a] = b;
+         }
+      }
+   }
+
+   // dominance, from the inputs towards the outputs so chains resolve
+   for (i = 0; i < node_queue.size(); i++) {
+      np = &Node[node_queue[i]];
+      c = controllingValue(np);
+      if (c == LOGIC_X || np->fin < 2) continue;
+      inv = (np->type == GATE_NAND || np->type == GATE_NOR);
+      for (j = 0; j < np->fin && (np->unodes[j]->fout != 1 || np->unodes[j]->po); j++);
+      if (j == np->fin) continue;
+      a = collapseFind(parent, FAULT_ID(np->indx, (1 - c) ^ inv));
+      b = collapseFind(parent, FAULT_ID(np->unodes[j]->indx, 1 - c));
+      while (domTo[b] >= 0) b = collapseFind(parent, domTo[b]);
+      if (a != b && domTo[a] < 0) domTo[a] = b;
+   }
+
+   faultRep.resize(nfaults);
+   faultDominated.assign(nfaults, 0);
+   faultMemberStart.assign(nfaults + 1, 0);
+   for (i = 0; i < nfaults; i++) {
+      a = collapseFind(parent, i);
+      while (domTo[a] >= 0) {
+         a = collapseFind(parent, domTo[a]);
+         faultDominated[i] = 1;
+      }
+      faultRep[i] = a;
+      faultMemberStart[a + 1]++;
+   }
+   for (i = 0; i < nfaults; i++) faultMemberStart[i + 1] += faultMemberStart[i];
+   faultMembers.resize(nfaults);
+   vector<int> fill(faultMemberStart.begin(), faultMemberStart.end() - 1);
+   for (i = 0; i < nfaults; i++) faultMembers[fill[faultRep[i]]++] = i;
+}
+
+/*-----------------------------------------------------------------------
+input: fault ids
+output: the representatives of their classes, each once, in list order
+called by: rtg, atpg_det, atpg
+description:
+  The faults of the list that are not representatives are set to
+  FAULT_EQUIVALENT, so that fault simulation leaves them alone until
+  expandFaultStatus gives them the status of their representative.
+-----------------------------------------------------------------------*/
+vector<int> collapseFaults(const vector<int> &ids)
+{
+   vector<int> targets;
+   vector<char> seen(2 * Nnodes, 0);
+
+   for (int i = 0; i < ids.size(); i++) {
+      int r = faultRep[ids[i]];
+      if (r != ids[i]) faultStatus[ids[i]] = FAULT_EQUIVALENT;
+      if (!seen[r]) {
+         seen[r] = 1;
+         targets.push_back(r);
+      }
+   }
+   return targets;
+}
+
+/*-----------------------------------------------------------------------
+input: fault ids
+output: the faults of the list that are left undetected without a status
+called by: rtg, atpg_det, atpg
+description:
+  Copies the status of every representative back to the faults of the
+  list it stands for. A fault that only dominates its representative is
+  detected with it, but an untestable or aborted representative says
+  nothing about it: the first time, such a fault is returned to be
+  targeted on its own, and later calls keep the status it got since.
+-----------------------------------------------------------------------*/
+vector<int> expandFaultStatus(const vector<int> &ids)
+{
+   vector<int> rest;
+
+   for (int i = 0; i < ids.size(); i++) {
+      int st = faultStatus[faultRep[ids[i]]];
+      if (faultRep[ids[i]] == ids[i]) continue;
+      if (faultDominated[ids[i]] && st != FAULT_DETECTED) {
+         if (faultStatus[ids[i]] != FAULT_EQUIVALENT) continue;
+         st = FAULT_UNDETECTED;
+         rest.push_back(ids[i]);
+      }
+      faultStatus[ids[i]] = st;
+   }
+   return rest;
+}
+
+
 int dfs(char *cp) {
 
    int i, j, index;
@@ -713,6 +1287,7 @@ int dfs(char *cp) {
    }
 
    map<int, int> output_values;     // dictionary to hold PO values
+   SearchState S(circuit);          // good and faulty node values
 
    // event driven simulation
    int k, l;
@@ -723,13 +1298,13 @@ int dfs(char *cp) {
          for (j = 0; j < Nnodes; j++){    // iterate over all the nodes
             if (Node[j].num == input_patterns[0][i]) {
                // cout << "Previous value of PI is " << input_patterns[k-1][i] << " - New value is " << input_patterns[k][i] << endl;
-               Node[j].value = input_patterns[k][i];
+               S.node[j].value = input_patterns[k][i];
                break;
             }
          }
       }
 
-      output_values = eval_gates(output_values);      // function call to evaluate the circuit
+      output_values = eval_gates(S, output_values);      // function call to evaluate the circuit
       all_fault.clear();
       lev();
 
@@ -743,15 +1318,15 @@ int dfs(char *cp) {
          np = &Node[node_queue[i]]; 
          if (np->type == 0) {      //PI
             f_val.first = np->num;
-            f_val.second = !np->value;
-            np->f_value = !np->value;
+            f_val.second = !S[np].value;
+            S[np].f_value = !S[np].value;
             det_fault_list.insert(f_val);
             all_fault[np->indx]=det_fault_list;
          } 
          else if (np->type == 1) {     // branch
             f_val.first = np->num;
-            f_val.second = !np->value;
-            np->f_value = !np->value;
+            f_val.second = !S[np].value;
+            S[np].f_value = !S[np].value;
             det_fault_list = all_fault[np->unodes[0]->indx];
             det_fault_list.insert(f_val);
             all_fault[np->indx]=det_fault_list;
@@ -772,13 +1347,13 @@ int dfs(char *cp) {
             }
 
             f_val.first = np->num;
-            if (np->value == 0) {
+            if (S[np].value == 0) {
                f_val.second = 1;
-               np->f_value = 1;
+               S[np].f_value = 1;
             } 
             else {
                f_val.second = 0;
-               np->f_value = 0;
+               S[np].f_value = 0;
             }
             det_fault_list.insert(f_val);
             // todo
@@ -786,12 +1361,12 @@ int dfs(char *cp) {
             all_fault[np->indx]=temp_fault_list2;
          } 
          else if (np->type == 3) {     // or
-            if (np->value == 0) {
+            if (S[np].value == 0) {
                for (j = 0; j < np->fin; j++) {
                   det_fault_list.insert(all_fault[np->unodes[j]->indx].begin(),all_fault[np->unodes[j]->indx].end());
                }
                f_val.second = 1;
-               np->f_value = 1;
+               S[np].f_value = 1;
                f_val.first = np->num;
                det_fault_list.insert(f_val);
                all_fault[np->indx]=det_fault_list;
@@ -800,7 +1375,7 @@ int dfs(char *cp) {
                int count = 0;
                //all_fault.erase(np->indx);
                for (j = 0; j < np->fin; j++) {
-                  if (np->unodes[j]->value == 1) {
+                  if (S[np->unodes[j]].value == 1) {
                      if (count == 0) {
                         index = np->unodes[j]->indx;
                      } else {
@@ -821,20 +1396,20 @@ int dfs(char *cp) {
                set_difference(det_fault_list.begin(), det_fault_list.end(), det_fault_nc_list.begin(), det_fault_nc_list.end(), std::inserter(temp_fault_list, temp_fault_list.begin()));
                f_val.first = np->num;
                f_val.second = 0;
-               np->f_value = 0;
+               S[np].f_value = 0;
                det_fault_list = temp_fault_list;
                det_fault_list.insert(f_val);
                all_fault[np->indx]=det_fault_list;
             }
          } 
          else if (np->type == 4) {     // nor
-            if (np->value == 1) {
+            if (S[np].value == 1) {
                for (j = 0; j < np->fin; j++) {
                   det_fault_list.insert(all_fault[np->unodes[j]->indx].begin(),all_fault[np->unodes[j]->indx].end());
                }
                f_val.first = np->num;
                f_val.second = 0;
-               np->f_value = 0;
+               S[np].f_value = 0;
                det_fault_list.insert(f_val);
                all_fault[np->indx]=det_fault_list;
             } 
@@ -842,7 +1417,7 @@ int dfs(char *cp) {
                int count = 0;
                //all_fault.erase(np->indx);
                for (j = 0; j < np->fin; j++) {
-                  if (np->unodes[j]->value == 1) {
+                  if (S[np->unodes[j]].value == 1) {
                      if (count == 0) {
                         index = np->unodes[j]->indx;
                      } else {
@@ -863,7 +1438,7 @@ int dfs(char *cp) {
                set_difference(det_fault_list.begin(), det_fault_list.end(), det_fault_nc_list.begin(), det_fault_nc_list.end(), std::inserter(temp_fault_list, temp_fault_list.begin()));
                f_val.first = np->num;
                f_val.second = 1;
-               np->f_value = 1;
+               S[np].f_value = 1;
                det_fault_list = temp_fault_list;
                det_fault_list.insert(f_val);
                all_fault[np->indx]=det_fault_list;
@@ -872,13 +1447,13 @@ int dfs(char *cp) {
          else if (np->type == 5) {     // not    
             det_fault_list = all_fault[np->unodes[0]->indx];
             f_val.first = np->num;
-            f_val.second = !np->value;
-            np->f_value = !np->value;
+            f_val.second = !S[np].value;
+            S[np].f_value = !S[np].value;
             det_fault_list.insert(f_val);
             all_fault[np->indx]=det_fault_list;
          }
          else if (np->type == 6) {     // nand
-            if (np->value == 0) {
+            if (S[np].value == 0) {
                //      f_val.second = 0;
                for (j = 0; j < np->fin; j++) {
                   det_fault_list.insert(all_fault[np->unodes[j]->indx].begin(),all_fault[np->unodes[j]->indx].end());
@@ -888,7 +1463,7 @@ int dfs(char *cp) {
                }
                f_val.first = np->num;
                f_val.second = 1;
-               np->f_value = 1;
+               S[np].f_value = 1;
                det_fault_list.insert(f_val);
                all_fault[np->indx]=det_fault_list;
             }
@@ -896,7 +1471,7 @@ int dfs(char *cp) {
                int count = 0;
                //all_fault.erase(np->indx);
                for (j = 0; j < np->fin; j++) {
-                  if (np->unodes[j]->value == 0) {
+                  if (S[np->unodes[j]].value == 0) {
                      if (count == 0) {
                         index = np->unodes[j]->indx;            
                      } else {
@@ -918,14 +1493,14 @@ int dfs(char *cp) {
 
                f_val.first = np->num;
                f_val.second = 0;
-               np->f_value = 0;
+               S[np].f_value = 0;
                det_fault_list = temp_fault_list;
                det_fault_list.insert(f_val);
                all_fault[np->indx]=det_fault_list;
             }
          } 
          else if (np->type == 7) {         // and
-            if (np->value == 1) {
+            if (S[np].value == 1) {
                f_val.second = 0;
                //det_fault_list = all_fault[np->unodes[0]->indx];
                for (j = 0; j < np->fin; j++) {
@@ -937,7 +1512,7 @@ int dfs(char *cp) {
                }
                f_val.first = np->num;
                f_val.second = 0;
-               np->f_value = 0;
+               S[np].f_value = 0;
                det_fault_list.insert(f_val);
                all_fault[np->indx]=det_fault_list;
             }
@@ -945,7 +1520,7 @@ int dfs(char *cp) {
                int count = 0;
                //all_fault.erase(np->indx);
                for (j = 0; j < np->fin; j++) {
-                  if (np->unodes[j]->value == 0) {
+                  if (S[np->unodes[j]].value == 0) {
                      if (count == 0) {
                         index = np->unodes[j]->indx;
                      } else {
@@ -967,7 +1542,7 @@ int dfs(char *cp) {
 
                f_val.first = np->num;
                f_val.second = 1;
-               np->f_value = 1;
+               S[np].f_value = 1;
                det_fault_list = temp_fault_list;
                det_fault_list.insert(f_val);
                all_fault[np->indx]=det_fault_list;
@@ -1014,189 +1589,480 @@ int dfs(char *cp) {
 }
 
 /*-----------------------------------------------------------------------
-input: test patterns, fault list
-output: detectable faults list
-called by: main
+input: fault list file, one num@value per line
+output: ids of its faults in file order (appended to ids); false if the
+        file cannot be opened
+called by: pfs, compact, atpg_det
 description:
-  The routine evaluates the circuit and determines the faults that can be detected for a given test pattern.
-  - levlize and add nodes to node_queue
+  Faults on node numbers the circuit does not have are left out.
+-----------------------------------------------------------------------*/
+bool readFaultList(const char *file, vector<int> &ids)
+{
+   ifstream fault_file(file);
+   if (!fault_file.is_open()) return false;
+   string fault_line;
+   int num, stuck;
+   while (getline(fault_file, fault_line)) {
+      if (sscanf(fault_line.c_str(), "%d@%d", &num, &stuck) != 2) continue;
+      if (num < 0 || num >= indxOfNum.size() || indxOfNum[num] < 0) continue;
+      ids.push_back(FAULT_ID(indxOfNum[num], stuck & 1));
+   }
+   return true;
+}
 
-  - for each row in input pattern file read input pattern to update values
-  -- get the fault list vector<pair<int,int>>
-  -- for each iteration (faults/width of int)
-  --- create a vector<pair<int,int>> of 32/64 to represent each bit and the corresponding fault
-  --- evaluate each node - return an int
-  --- check if the node is in the fault list (read the fault list)
-  --- = if in the fault list, then modify the corresponding bit
-  --- store each node as an int in a map<int,int> (node->num, bits vector)
+/*-----------------------------------------------------------------------
+input: file name, fault ids
+output: the faults as num@value lines; false if the file cannot be created
+called by: rfl, pfs
 -----------------------------------------------------------------------*/
-int pfs(char *cp)
+bool writeFaultList(const char *file, const vector<int> &ids)
 {
-   int i, j;
-   NSTRUC *np;
-   char in_pattern_buf[MAXLINE], in_faults_buf[MAXLINE], out_buf[MAXLINE];
-   sscanf(cp, "%s %s %s", in_pattern_buf, in_faults_buf, out_buf);
+   ofstream output_file(file);
+   if (!output_file) return false;
+   for (int i = 0; i < ids.size(); i++) {
+      output_file << Node[FAULT_NODE(ids[i])].num << "@" << FAULT_STUCK(ids[i]) << endl;
+   }
+   return true;
+}
 
-   // read input patterns
-   vector<vector<int> > input_patterns;
-   vector<int> input_pattern_line;
-   ifstream input_file;
-   input_file.open(in_pattern_buf);
-   string input_line, token;
-   if ( input_file.is_open() ) {
-      while ( input_file ) {
-         getline (input_file, input_line);   // read line from pattern file
-         stringstream X(input_line);
-         while (getline(X, token, ',')) {
-            input_pattern_line.push_back(stoi(token));
-         }
-         if (input_line != "") {
-            input_patterns.push_back(input_pattern_line);
+/*-----------------------------------------------------------------------
+input: evaluation order (from lev), one pattern (values of Pinput[0..Npi-1]),
+       the active fault ids
+output: faultStatus FAULT_DETECTED for every fault the pattern detects,
+        which also leave active
+called by: pfs, compact, rtg, atpgSchedule, atpg
+description:
+  Parallel fault simulation of one pattern in 64-bit words: bit 0 is the
+  fault-free circuit and bits 1-63 carry one fault each. Faults that are
+  detected, proven untestable or collapsed into another one are dropped
+  from active first, so only the remaining ones are simulated and the list
+  shrinks in place as the patterns detect faults.
+-----------------------------------------------------------------------*/
+void pfsPattern(const vector<int> &order, const vector<int> &pattern, vector<int> &active)
+{
+   int live = 0;
+   for (int i = 0; i < active.size(); i++) {
+      unsigned char st = faultStatus[active[i]];
+      if (st == FAULT_UNDETECTED || st == FAULT_ABORTED) active[live++] = active[i];
+   }
+   active.resize(live);
+
+   vector<uint64_t> val(Nnodes), sa0(Nnodes, ~0ULL), sa1(Nnodes, 0);
+   for (int p = 0; p < active.size(); p += 63) {
+      int n = min((int) active.size() - p, 63);
+      // inject the faults of this pass
+      for (int k = 0; k < n; k++) {
+         int id = active[p+k];
+         uint64_t bit = 1ULL << (k+1);
+         if (FAULT_STUCK(id) == 0) sa0[FAULT_NODE(id)] &= ~bit;
+         else sa1[FAULT_NODE(id)] |= bit;
+      }
+      for (int i = 0; i < Npi; i++) val[Pinput[i]->indx] = pattern[i] ? ~0ULL : 0;
+
+      for (int i = 0; i < order.size(); i++) {
+         NSTRUC *np = &Node[order[i]];
+         uint64_t w = val[np->indx];
+         switch (np->type) {
+            case GATE_BRANCH: w = val[np->unodes[0]->indx]; break;
+            case GATE_NOT: w = ~val[np->unodes[0]->indx]; break;
+            case GATE_XOR:
+               w = 0;
+               for (int j = 0; j < np->fin; j++) w ^= val[np->unodes[j]->indx];
+               break;
+            case GATE_OR:
+            case GATE_NOR:
+               w = 0;
+               for (int j = 0; j < np->fin; j++) w |= val[np->unodes[j]->indx];
+               if (np->type == GATE_NOR) w = ~w;
+               break;
+            case GATE_AND:
+            case GATE_NAND:
+               w = ~0ULL;
+               for (int j = 0; j < np->fin; j++) w &= val[np->unodes[j]->indx];
+               if (np->type == GATE_NAND) w = ~w;
+               break;
+            default: break;
          }
-         input_pattern_line.clear();
+         val[np->indx] = (w & sa0[np->indx]) | sa1[np->indx];
+      }
+
+      // a fault is detected where a primary output differs from bit 0
+      uint64_t diff = 0;
+      for (int i = 0; i < Npo; i++) {
+         uint64_t w = val[Poutput[i]->indx];
+         diff |= w ^ ((w & 1) ? ~0ULL : 0);
+      }
+      for (int k = 0; k < n; k++) {
+         int id = active[p+k];
+         if (diff & (1ULL << (k+1))) faultStatus[id] = FAULT_DETECTED;
+         sa0[FAULT_NODE(id)] = ~0ULL;
+         sa1[FAULT_NODE(id)] = 0;
       }
-      input_file.close();
    }
-   else {
-      cout << "Couldn't open file\n";
-      return 1;
+
+   live = 0;
+   for (int i = 0; i < active.size(); i++) {
+      if (faultStatus[active[i]] != FAULT_DETECTED) active[live++] = active[i];
    }
+   active.resize(live);
+}
 
-   // read fault list
-   vector<pair<int,int> > fault_list;
-   pair<int,int> fault;
-   ifstream fault_file;
-   fault_file.open(in_faults_buf);
-   string fault_line;
-   if ( fault_file.is_open() ) {
-      while ( fault_file ) {
-         getline (fault_file, fault_line);   // read line from fault list file
-         stringstream X(fault_line);
-         i = 0;
-         while (getline(X, token, '@')) {
-            if (i == 0 ) {
-               fault.first = (stoi(token));
-               i = 1;
-            } else {
-               fault.second = stoi(token);
+/*-----------------------------------------------------------------------
+input: evaluation order (from lev), patterns (values of Pinput[0..Npi-1]),
+       fault ids
+output: faultStatus FAULT_DETECTED for every fault the patterns detect
+called by: atpgSchedule, atpgCompact
+description:
+  Pattern-parallel single-fault propagation. A PatternBatch holds up to
+  BATCH_PATTERNS patterns, bit k of every word belonging to pattern k, and
+  the good-machine values they give every node. A fault is simulated
+  against all of them at once: its faulty words are propagated through its
+  fanout cone in level order, and it is detected where a primary output
+  differs from the good value. The faults marked detected are also listed
+  in dropped, for the caller to collect.
+-----------------------------------------------------------------------*/
+#define BATCH_PATTERNS 64
+
+struct PatternBatch {
+   const vector<int> *order;    // evaluation order (from lev)
+   int count;                   // patterns in the batch
+   vector<uint64_t> good;       // good-machine value of every node
+   vector<uint64_t> faulty;     // faulty value of the nodes stamped with the current fault
+   vector<int> stamp, queued;
+   int now;
+   vector<vector<int> > bucket; // per-level nodes to evaluate for the current fault
+   vector<int> dropped;         // fault ids marked detected
+};
+
+/* word of gate np from the words of its inputs, in(x) giving the word of node x */
+template <class F> uint64_t batchGate(NSTRUC *np, F in)
+{
+   uint64_t w = 0;
+   switch (np->type) {
+      case GATE_BRANCH: return in(np->unodes[0]);
+      case GATE_NOT: return ~in(np->unodes[0]);
+      case GATE_XOR:
+         for (int j = 0; j < np->fin; j++) w ^= in(np->unodes[j]);
+         return w;
+      case GATE_OR:
+      case GATE_NOR:
+         for (int j = 0; j < np->fin; j++) w |= in(np->unodes[j]);
+         return (np->type == GATE_NOR) ? ~w : w;
+      case GATE_AND:
+      case GATE_NAND:
+         w = ~0ULL;
+         for (int j = 0; j < np->fin; j++) w &= in(np->unodes[j]);
+         return (np->type == GATE_NAND) ? ~w : w;
+      default: return w;
+   }
+}
+
+void batchInit(PatternBatch &b, const vector<int> &order)
+{
+   b.order = &order;
+   b.count = 0;
+   b.good.assign(Nnodes, 0);
+   b.faulty.assign(Nnodes, 0);
+   b.stamp.assign(Nnodes, 0);
+   b.queued.assign(Nnodes, 0);
+   b.now = 0;
+   b.bucket.assign(maxLevel + 1, vector<int>());
+   b.dropped.clear();
+}
+
+/* add pattern as pattern b.count and simulate the good machine (the batch must not be full) */
+void batchAdd(PatternBatch &b, const vector<int> &pattern)
+{
+   uint64_t bit = 1ULL << b.count++;
+   for (int i = 0; i < Npi; i++) {
+      uint64_t &w = b.good[Pinput[i]->indx];
+      w = pattern[i] ? (w | bit) : (w & ~bit);
+   }
+   for (int i = 0; i < b.order->size(); i++) {
+      NSTRUC *np = &Node[(*b.order)[i]];
+      if (np->type != GATE_PI) b.good[np->indx] = batchGate(np, [&](NSTRUC *x) { return b.good[x->indx]; });
+   }
+}
+
+/* does a pattern of b detect fault id? */
+bool batchDetects(PatternBatch &b, int id)
+{
+   if (b.count == 0) return false;
+   uint64_t mask = (b.count == 64) ? ~0ULL : (1ULL << b.count) - 1;
+   NSTRUC *site = &Node[FAULT_NODE(id)];
+   uint64_t fw = FAULT_STUCK(id) ? ~0ULL : 0;
+   if (((fw ^ b.good[site->indx]) & mask) == 0) return false;
+   if (site->po) return true;
+
+   auto in = [&](NSTRUC *x) { return (b.stamp[x->indx] == b.now) ? b.faulty[x->indx] : b.good[x->indx]; };
+   b.now++;
+   b.faulty[site->indx] = fw;
+   b.stamp[site->indx] = b.now;
+   for (int j = 0; j < site->fout; j++) {
+      NSTRUC *dp = site->dnodes[j];
+      if (b.queued[dp->indx] != b.now) {
+         b.queued[dp->indx] = b.now;
+         b.bucket[dp->level].push_back(dp->indx);
+      }
+   }
+   bool detected = false;
+   for (int l = site->level + 1; l <= maxLevel; l++) {
+      for (int k = 0; k < b.bucket[l].size() && !detected; k++) {
+         NSTRUC *np = &Node[b.bucket[l][k]];
+         uint64_t w = batchGate(np, in);
+         if (((w ^ b.good[np->indx]) & mask) == 0) continue;
+         b.faulty[np->indx] = w;
+         b.stamp[np->indx] = b.now;
+         if (np->po) detected = true;
+         for (int j = 0; j < np->fout; j++) {
+            NSTRUC *dp = np->dnodes[j];
+            if (b.queued[dp->indx] != b.now) {
+               b.queued[dp->indx] = b.now;
+               b.bucket[dp->level].push_back(dp->indx);
             }
          }
-         if (fault_line != "") {
-            fault_list.push_back(fault);
+      }
+      b.bucket[l].clear();
+   }
+   return detected;
+}
+
+/* is fault id detected by a pattern simulated before or by one in b? a fault
+   that is undetected or aborted so far is simulated against b, and marked */
+bool batchDetected(PatternBatch &b, int id)
+{
+   unsigned char st = faultStatus[id];
+   if (st == FAULT_DETECTED) return true;
+   if (st != FAULT_UNDETECTED && st != FAULT_ABORTED) return false;
+   if (!batchDetects(b, id)) return false;
+   faultStatus[id] = FAULT_DETECTED;
+   b.dropped.push_back(id);
+   return true;
+}
+
+/* simulate the patterns of b against active, like pfsPattern for each of
+   them in turn, and empty b */
+void batchFlush(PatternBatch &b, vector<int> &active)
+{
+   int live = 0;
+   for (int i = 0; i < active.size(); i++) {
+      unsigned char st = batchDetected(b, active[i]) ? FAULT_DETECTED : faultStatus[active[i]];
+      if (st == FAULT_UNDETECTED || st == FAULT_ABORTED) active[live++] = active[i];
+   }
+   active.resize(live);
+   b.count = 0;
+}
+
+/*-----------------------------------------------------------------------
+input: test patterns, fault list
+output: detectable faults list
+called by: main
+description:
+  The routine evaluates the circuit and determines the faults that can be detected for a given test pattern.
+  - levlize and add nodes to node_queue
+  - read the fault list as fault ids and map each pattern row to Pinput order
+  - simulate every row with pfsPattern, dropping the faults already detected
+-----------------------------------------------------------------------*/
+int pfs(char *cp)
+{
+   int i, j;
+   NSTRUC *np;
+   char in_pattern_buf[MAXLINE], in_faults_buf[MAXLINE], out_buf[MAXLINE];
+   sscanf(cp, "%s %s %s", in_pattern_buf, in_faults_buf, out_buf);
+
+   // read input patterns
+   vector<vector<int> > input_patterns;
+   vector<int> input_pattern_line;
+   ifstream input_file;
+   input_file.open(in_pattern_buf);
+   string input_line, token;
+   if ( input_file.is_open() ) {
+      while ( input_file ) {
+         getline (input_file, input_line);   // read line from pattern file
+         stringstream X(input_line);
+         while (getline(X, token, ',')) {
+            input_pattern_line.push_back(stoi(token));
+         }
+         if (input_line != "") {
+            input_patterns.push_back(input_pattern_line);
          }
+         input_pattern_line.clear();
       }
-      fault_file.close();
+      input_file.close();
    }
    else {
       cout << "Couldn't open file\n";
       return 1;
    }
 
+   // read fault list
+   vector<int> fault_list;
+   if (!readFaultList(in_faults_buf, fault_list)) {
+      cout << "Couldn't open file\n";
+      return 1;
+   }
+
    // levelize
    lev();
 
-   set<pair<int,int> > detected_faults;     // stores the final faults to be written out
-   vector<pair<int,int> > bit_faults;      // stores the bit position of each fault
-   bitset<sizeof(int)*8> value;     // used to easily manipulate bits in the value
-   int k, l, m;
-   int expected_value;
-   for (k = 1; k < input_patterns.size(); k++) {    // iterate over all the rows of test patterns
-      // iterate over the faults and add to the respective bit position
-      for (l = 0; l < fault_list.size(); l = l + (sizeof(int)*8) - 1) {
-         bit_faults.clear();
-         bit_faults.push_back(make_pair(-1,-1));      // 0th element is used for fault-free circuit
-         for (m = 0; (m < (sizeof(int)*8)-1 && m < (fault_list.size() - ((sizeof(int)*8)-1)*l)); m++) {
-            bit_faults.push_back(fault_list[l+m]);
+   // patterns in Pinput order
+   vector<int> column(Npi, -1);
+   for (i = 0; i < Npi; i++) {
+      for (j = 0; j < input_patterns[0].size(); j++) {
+         if (input_patterns[0][j] == Pinput[i]->num) column[i] = j;
+      }
+   }
+
+   for (i = 0; i < fault_list.size(); i++) faultStatus[fault_list[i]] = FAULT_UNDETECTED;
+   vector<int> active(fault_list);
+   vector<int> pattern(Npi);
+   for (int k = 1; k < input_patterns.size(); k++) {    // iterate over all the rows of test patterns
+      for (i = 0; i < Npi; i++) pattern[i] = (column[i] < 0) ? 0 : input_patterns[k][column[i]];
+      pfsPattern(node_queue, pattern, active);
+   }
+
+   // the detected faults, ordered by node number
+   vector<int> detected_faults;
+   for (i = 0; i < fault_list.size(); i++) {
+      if (faultStatus[fault_list[i]] == FAULT_DETECTED) detected_faults.push_back(fault_list[i]);
+   }
+   sort(detected_faults.begin(), detected_faults.end(), [](int a, int b) {
+      return make_pair(Node[FAULT_NODE(a)].num, a) < make_pair(Node[FAULT_NODE(b)].num, b);
+   });
+   detected_faults.erase(unique(detected_faults.begin(), detected_faults.end()), detected_faults.end());
+
+   if (!writeFaultList(out_buf, detected_faults)) {
+      cout << "Couldn't create file\n";
+      return 1;
+   }
+
+   cout << "OK" << endl;
+   return 0;
+}
+
+/*-----------------------------------------------------------------------
+input: pattern file (first row PI numbers, then one cube per row with 0, 1
+       or X), fault list file, output file, optional number of random passes
+output: minimized pattern file with the same fault coverage
+called by: main
+description:
+  Static compaction.
+  - merge compatible cubes: a cube is folded into the first earlier one
+    that does not assign any PI the opposite value
+  - fill the X bits left with rand()
+  - fault simulate the patterns in reverse order with fault dropping and
+    keep only the ones that detect a fault not detected before
+  - repeat that in random orders, which can drop more patterns
+  Every pass keeps all the faults the patterns detect, so the coverage of
+  the fault list does not change. Simulation is the bit-parallel pfsPattern.
+-----------------------------------------------------------------------*/
+int compact(char *cp)
+{
+   int i, j, k;
+   char in_pattern_buf[MAXLINE], in_faults_buf[MAXLINE], out_buf[MAXLINE], passes_buf[MAXLINE];
+   int nargs = sscanf(cp, "%s %s %s %s", in_pattern_buf, in_faults_buf, out_buf, passes_buf);
+   int passes = (nargs >= 4) ? stoi(passes_buf) : 4;
+
+   // read input cubes, X as LOGIC_X
+   vector<vector<int> > input_patterns;
+   vector<int> input_pattern_line;
+   ifstream input_file;
+   input_file.open(in_pattern_buf);
+   string input_line, token;
+   if ( input_file.is_open() ) {
+      while ( input_file ) {
+         getline (input_file, input_line);   // read line from pattern file
+         stringstream X(input_line);
+         while (getline(X, token, ',')) {
+            if (token == "X" || token == "x") input_pattern_line.push_back(LOGIC_X);
+            else input_pattern_line.push_back(stoi(token));
          }
-         // evaluate the gates and inject faults
-         for (i = 0; i < input_patterns[0].size(); i++) {     // iterate over all the PIs in the Kth row
-            for (j = 0; j < Nnodes; j++){    // iterate over all the nodes
-               if (Node[j].num == input_patterns[0][i]) {      // set PI to input pattern
-                  if (input_patterns[k][i] == 0) {
-                     value.reset();
-                  } else {
-                     value.set();
-                  }
-                  Node[j].value = value.to_ulong();
-               }
-            }
+         if (input_line != "") {
+            input_patterns.push_back(input_pattern_line);
          }
+         input_pattern_line.clear();
+      }
+      input_file.close();
+   }
+   else {
+      cout << "Couldn't open file\n";
+      return 1;
+   }
 
-         NSTRUC *np;
-         //now, go through the elements in the node_queue and evaluate
-         for (i = 0; i < node_queue.size(); i++) {
-            np = &Node[node_queue[i]];    // read the node data
-            switch(np->type) {
-               case 0:  // PI
-                  break;      
-               case 1:  // BRANCH
-                  np->value = np->unodes[0]->value;
-                  break;
-               case 2:  // XOR
-                  np->value = np->unodes[0]->value; 
-                  for (j = 1; j < np->fin; j++) {
-                     np->value = np->value ^ np->unodes[j]->value;
-                  }
-                  break; 
-               case 3:  // OR
-                  np->value = 0;  
-                  for (j = 0; j < np->fin; j++) {
-                     np->value = np->value | np->unodes[j]->value;
-                  } 
-                  break;
-               case 4:  // NOR
-                  np->value = 0;    
-                  for (j = 0; j < np->fin; j++) {
-                     np->value = np->value | np->unodes[j]->value;
-                  }
-                  np->value = ~np->value;
-                  break; 
-               case 5: // NOT
-                  np->value = ~(np->unodes[0]->value); 
-                  break; 
-               case 6:  // NAND
-                  np->value = -1;      // initialize all bit positions to 1
-                  for (j = 0; j < np->fin; j++) {
-                     np->value = np->value & np->unodes[j]->value;
-                  }
-                  np->value = ~np->value;
-                  break; 
-               case 7:  // AND
-                  np->value = -1;      // initialize all bit positions to 1
-                  for (j = 0; j < np->fin; j++) {
-                     np->value = np->value & np->unodes[j]->value;
-                  }
-                  break; 
-            }
+   // read fault list
+   vector<int> fault_list;
+   if (!readFaultList(in_faults_buf, fault_list)) {
+      cout << "Couldn't open file\n";
+      return 1;
+   }
+   if (input_patterns.empty()) {
+      cout << "Empty pattern file\n";
+      return 1;
+   }
 
-            // inject fault
-            value = bitset<sizeof(int)*8>(np->value);
+   // levelize
+   lev();
 
-            // check if node has fault in bit_faults
-            for (j = 0; j<bit_faults.size(); j++) {
-               if (bit_faults[j].first == np->num) {
-                  value.set(j,bit_faults[j].second);
-               }
-            }
-            np->value = value.to_ulong();
-            if (np->fout == 0) {
-               expected_value = value[0];
-               for (j = 1; j < sizeof(int)*8; j++) {
-                  if (value.test(j) != expected_value) {
-                     detected_faults.insert(bit_faults[j]);
-                  }
-               }
-            }
+   // cubes in Pinput order (X for PIs the file leaves out)
+   vector<int> column(Npi, -1);
+   for (i = 0; i < Npi; i++) {
+      for (j = 0; j < input_patterns[0].size(); j++) {
+         if (input_patterns[0][j] == Pinput[i]->num) column[i] = j;
+      }
+   }
+
+   // merge compatible cubes
+   vector<vector<int> > cubes;
+   vector<int> cube(Npi);
+   for (k = 1; k < input_patterns.size(); k++) {
+      for (i = 0; i < Npi; i++) cube[i] = (column[i] < 0) ? LOGIC_X : input_patterns[k][column[i]];
+      for (j = 0; j < cubes.size(); j++) {
+         for (i = 0; i < Npi; i++) {
+            if (cube[i] != LOGIC_X && cubes[j][i] != LOGIC_X && cube[i] != cubes[j][i]) break;
          }
+         if (i == Npi) break;
+      }
+      if (j == cubes.size()) {
+         cubes.push_back(cube);
+         continue;
+      }
+      for (i = 0; i < Npi; i++) {
+         if (cube[i] != LOGIC_X) cubes[j][i] = cube[i];
       }
    }
-   
+   for (j = 0; j < cubes.size(); j++) {
+      for (i = 0; i < Npi; i++) {
+         if (cubes[j][i] == LOGIC_X) cubes[j][i] = rand()%2;
+      }
+   }
+
+   // reverse order first, then random orders: keep the patterns that detect something new
+   vector<int> order;
+   for (j = cubes.size() - 1; j >= 0; j--) order.push_back(j);
+   for (int pass = 0; pass <= passes; pass++) {
+      if (pass > 0) {
+         for (j = order.size() - 1; j > 0; j--) swap(order[j], order[rand() % (j + 1)]);
+      }
+      for (i = 0; i < fault_list.size(); i++) faultStatus[fault_list[i]] = FAULT_UNDETECTED;
+      vector<int> active(fault_list);
+      vector<int> kept;
+      for (j = 0; j < order.size(); j++) {
+         int before = active.size();
+         pfsPattern(node_queue, cubes[order[j]], active);
+         if (active.size() < before) kept.push_back(order[j]);
+      }
+      order = kept;
+   }
+   sort(order.begin(), order.end());
+
    ofstream output_file;
    output_file.open(out_buf);
-
    if ( output_file ) {
-      for (auto const& element : detected_faults) {
-         output_file << element.first << "@" << element.second << endl;
+      for (i = 0; i < Npi; i++) output_file << (i ? "," : "") << Pinput[i]->num;
+      output_file << endl;
+      for (j = 0; j < order.size(); j++) {
+         for (i = 0; i < Npi; i++) output_file << (i ? "," : "") << cubes[order[j]][i];
+         output_file << endl;
       }
    }
    else {
@@ -1204,6 +2070,54 @@ int pfs(char *cp)
       return 1;
    }
 
+   cout << "Patterns: " << input_patterns.size() - 1 << " -> " << order.size() << endl;
+   cout << "OK" << endl;
+   return 0;
+}
+
+/*-----------------------------------------------------------------------
+input: output file, optional map file
+output: the representative faults of the collapsed universe as num@value
+        lines; the map file gets one line per representative followed by
+        the faults it stands for, a '>' before the ones that only dominate it
+called by: main
+description:
+  The collapsing itself is done by collapse() when the circuit is read.
+-----------------------------------------------------------------------*/
+int collapsecmd(char *cp)
+{
+   int i, j, r, ndominated = 0;
+   char out_buf[MAXLINE], map_buf[MAXLINE];
+   int nargs = sscanf(cp, "%s %s", out_buf, map_buf);
+
+   vector<int> reps;
+   for (i = 0; i < 2 * Nnodes; i++) {
+      if (faultRep[i] == i) reps.push_back(i);
+   }
+   if (!writeFaultList(out_buf, reps)) {
+      cout << "Couldn't create file\n";
+      return 1;
+   }
+
+   for (i = 0; i < 2 * Nnodes; i++) ndominated += faultDominated[i];
+   if (nargs >= 2) {
+      ofstream map_file(map_buf);
+      if (!map_file) {
+         cout << "Couldn't create file\n";
+         return 1;
+      }
+      for (i = 0; i < reps.size(); i++) {
+         r = reps[i];
+         map_file << Node[FAULT_NODE(r)].num << "@" << FAULT_STUCK(r) << ":";
+         for (j = faultMemberStart[r]; j < faultMemberStart[r + 1]; j++) {
+            if (faultMembers[j] == r) continue;
+            map_file << " " << (faultDominated[faultMembers[j]] ? ">" : "") << Node[FAULT_NODE(faultMembers[j])].num << "@" << FAULT_STUCK(faultMembers[j]);
+         }
+         map_file << endl;
+      }
+   }
+
+   cout << "Faults: " << 2 * Nnodes << " -> " << reps.size() << " (" << ndominated << " dropped by dominance)" << endl;
    cout << "OK" << endl;
    return 0;
 }
@@ -1225,8 +2139,7 @@ int rtg(char *cp) {
    int ntot = stoi(ntot_buf);
    int nTFCR = stoi(nTFCR_buf);
 
-   vector<pair<int, int> > fault_list;     // dictionary to hold PO values
-   pair<int,int> fault;    // temporarily holds the faults
+   vector<int> fault_list;     // fault ids
 
    vector<int> PI;
    vector<int> input_values;
@@ -1242,10 +2155,8 @@ int rtg(char *cp) {
       }
 
       // add faults
-      fault.first = np->num;
       for (j = 0; j < 2; j++) {     // assign value of 0 and 1 to the faulty node
-         fault.second = j; 
-         fault_list.push_back(fault);     // add the fault to the fault_list
+         fault_list.push_back(FAULT_ID(i, j));     // add the fault to the fault_list
       }
    }
 
@@ -1271,7 +2182,13 @@ int rtg(char *cp) {
    ofstream output_fc_file;
    output_fc_file.open(fc_buf);
 
-   set<pair<int,int> > detected_faults;
+   // simulate every pattern against the faults not detected yet
+   lev();
+   vector<int> sim_order = node_queue;
+   node_queue.clear();
+   // only the representatives of the collapsed classes are simulated
+   for (i = 0; i < fault_list.size(); i++) faultStatus[fault_list[i]] = FAULT_UNDETECTED;
+   vector<int> active = collapseFaults(fault_list);
 
    int test_patterns_generated = 0;
    srand(time(0));
@@ -1287,67 +2204,7 @@ int rtg(char *cp) {
          input_values.clear();
       }
       
-      // write the fault list and test patterns to temp files inorder to pass them to PFS
-      ofstream output_file;
-      output_file.open("fault_list_temp.txt");
-      if ( output_file ) {
-         for (i = 0; i < fault_list.size(); i++) {
-            output_file << fault_list[i].first << "@" << fault_list[i].second << endl;
-         }
-      } else {
-         cout << "Couldn't create file\n";
-      }
-      output_file.close();
-      
-      flag = 0;
-      output_file.open("test_pattern_temp.txt");
-      if ( output_file ) {
-         for (i = 0; i < test_patterns.size(); i++) {
-            for (j = 0; j < test_patterns[0].size(); j++) {
-               if (flag == 0) {
-                  output_file << test_patterns[i][j];
-                  flag = 1;
-               } else {
-                  output_file << "," << test_patterns[i][j];
-               }
-            }
-            output_file << endl;
-            flag = 0;
-         }
-      } else {
-         cout << "Couldn't create file\n";
-      }
-      output_file.close();
-
-      string pfs_arguments = "test_pattern_temp.txt fault_list_temp.txt detected_faults_temp.txt";
-      pfs(strdup(pfs_arguments.c_str()));
-
-      // read fault list
-      ifstream fault_file;
-      fault_file.open("detected_faults_temp.txt");
-      string fault_line, token;
-      if ( fault_file.is_open() ) {
-         while ( fault_file ) {
-            getline (fault_file, fault_line);   // read line from fault list file
-            stringstream X(fault_line);
-            i = 0;
-            while (getline(X, token, '@')) {
-               if (i == 0 ) {
-                  fault.first = (stoi(token));
-                  i = 1;
-               } else {
-                  fault.second = stoi(token);
-               }
-            }
-            if (fault_line != "") {
-               detected_faults.insert(fault);
-            }
-         }
-         fault_file.close();
-      }
-      else {
-         cout << "Couldn't open file\n";
-      }
+      for (i = 1; i < test_patterns.size(); i++) pfsPattern(sim_order, test_patterns[i], active);
 
       // print test patterns to a file
       flag = 0;
@@ -1368,9 +2225,15 @@ int rtg(char *cp) {
          cout << "Couldn't create file\n";
       }
 
-      // print FC report
+      // print FC report, over the full fault list; a fault that only dominates
+      // a representative not detected yet is simulated on its own from now on
+      vector<int> rest = expandFaultStatus(fault_list);
+      for (i = 1; i < test_patterns.size() && !rest.empty(); i++) pfsPattern(sim_order, test_patterns[i], rest);
+      active.insert(active.end(), rest.begin(), rest.end());
+      int num_detected = 0;
+      for (i = 0; i < fault_list.size(); i++) num_detected += (faultStatus[fault_list[i]] == FAULT_DETECTED);
       if ( output_fc_file ) {
-         output_fc_file << fixed << setprecision(2) << detected_faults.size()*100.0/fault_list.size() << endl;
+         output_fc_file << fixed << setprecision(2) << num_detected*100.0/fault_list.size() << endl;
       } else {
          cout << "Couldn't create file\n";
       }
@@ -1421,116 +2284,183 @@ int level(char *cp) {
 // --------------------------------------------------------Phase 3--------------------------------------------------
 //----------------------------
 // Functions for logic simulation - PODEM imply
-void simFullCircuit();
-void simGateRecursive(NSTRUC* g);
-int simGate(NSTRUC* g);
-int evalGate(vector<int> in, int c, int i);
-int EvalXORGate(vector<int> in, int inv);
+void simFullCircuit(SearchState &S);
+void simGateRecursive(SearchState &S, NSTRUC* g);
+int simGate(SearchState &S, NSTRUC* g);
 int LogicNot(int logicVal);
-void setValueCheckFault(NSTRUC* g, int gateValue);
+void setValueCheckFault(SearchState &S, NSTRUC* g, int gateValue);
+int applyFault(SearchState &S, NSTRUC* g, int gateValue);
+//-----------------------------
+
+//----------------------------
+// Functions for event-driven implication - PODEM imply
+void podemImply(SearchState &S, NSTRUC* g, int val);
+void podemSetValue(SearchState &S, NSTRUC* g, int gateValue);
+void podemUndo(SearchState &S, size_t mark);
+//-----------------------------
+
+//----------------------------
+// Functions for dual-rail bit-parallel implication - PODEM speculation
+drword drFromLogic(int logicVal);
+drword drInput(SearchState &S, NSTRUC* g);
+drword drSimGate(SearchState &S, NSTRUC* g);
+drword drApplyFault(SearchState &S, NSTRUC* g, drword w);
+void drSetValue(SearchState &S, NSTRUC* np, drword w);
+int podemSpeculate(SearchState &S, NSTRUC* pi, int &detectMask);
+//-----------------------------
+
+//----------------------------
+// Functions for static learning - PODEM conflict checks and DALG implication
+int goodValue(int logicVal);
+void markFaultCone(SearchState &S, NSTRUC* site);
+bool learnConflict(SearchState &S, NSTRUC* g, int v);
+bool learnImply(SearchState &S, NSTRUC* g, int level);
+bool podemLearnBlocked(SearchState &S, NSTRUC* g, int v);
+//-----------------------------
+
+//----------------------------
+// Functions for SAT ATPG:
+int satAtpg(SearchState &S, NSTRUC* site, int stuck);
+//-----------------------------
+
+//----------------------------
+// Functions for FAN:
+int fanSearch(SearchState &S);
+bool fanIsHead(SearchState &S, NSTRUC* g);
+void mbAdd(SearchState &S, NSTRUC* g, int n0, int n1);
+bool fanObjectives(SearchState &S, vector<pair<NSTRUC *, int> > &obj);
+bool fanMultipleBacktrace(SearchState &S, vector<pair<NSTRUC *, int> > obj, NSTRUC* &head, int &headVal);
+void fanJustify(SearchState &S, NSTRUC* g, int v);
+void writeTestCube(string output_file, const vector<int> &cube);
+vector<int> atpgTestCube(SearchState &S);
 //-----------------------------
 
 //----------------------------
 // Functions for PODEM:
-bool podemRecursion();
-bool getObjective(NSTRUC* &g, int &v);
-void updateDFrontier();
-void backtrace(NSTRUC* &pi, int &piVal, NSTRUC* objGate, int objVal);
+int podemSearch(SearchState &S);
+bool atpgBudgetExceeded(SearchState &S, int backtracks, std::chrono::steady_clock::time_point tStart);
+bool getObjective(SearchState &S, NSTRUC* &g, int &v);
+bool sensitizeDominators(SearchState &S, NSTRUC* d, vector<pair<NSTRUC *, int> > &obj);
+NSTRUC* dFrontierDominator(SearchState &S);
+void dFrontierUpdate(SearchState &S, NSTRUC* g);
+NSTRUC* dFrontierBest(SearchState &S);
+bool xPathCheck(SearchState &S);
+bool xPathFrom(SearchState &S, NSTRUC* g);
+void backtrace(SearchState &S, NSTRUC* &pi, int &piVal, NSTRUC* objGate, int objVal);
 
 //--------------------------
 // MAIN PODEM
-clock_t podem_recursion_tStart;
+
+/** @brief Set every gate to X and inject the fault at site, ready for a PODEM or FAN search.
+ */
+void podemReset(SearchState &S, NSTRUC* site, int stuck) {
+   S.podem_tStart = std::chrono::steady_clock::now();
+   for (int i=0; i < S.C.nnodes; i++) {
+      S.node[i].fault = NOFAULT;
+      S.node[i].value = LOGIC_X;
+      S.node[i].dfpos = -1;
+   }
+   S.faultLocation = site;
+   S[site].fault = stuck;
+   S.faultActivationVal = (stuck == FAULT_SA0) ? LOGIC_1 : LOGIC_0;
+
+   // initialize the D frontier and the implication state.
+   S.dFrontier.clear();
+   S.podemTrail.clear();
+   S.eventQueue.assign(S.C.maxLevel + 1, vector<NSTRUC *>());
+   markFaultCone(S, site);
+}
+
+/** @brief PODEM for fault (an id); faults it gives up on go to the SAT engine,
+ * which can also prove them untestable.
+ * \returns ATPG_DETECTED with the test in the PI values of S, ATPG_UNTESTABLE
+ * or ATPG_ABORTED. Writes no files.
+ */
+int podemGenerate(const Circuit &C, SearchState &S, int fault) {
+   NSTRUC *site = &C.node[FAULT_NODE(fault)];
+   podemReset(S, site, FAULT_STUCK(fault));
+   int res = podemSearch(S);
+   if (res == ATPG_ABORTED) res = satAtpg(S, site, FAULT_STUCK(fault));
+   return res;
+}
+
+/** @brief Fault id of the node number and stuck value arguments of PODEM, FAN, SAT and DALG, -1 if there is no such node. */
+int faultArg(const char *node_buf, const char *value_buf) {
+   int num = stoi(node_buf);
+   if (num < 0 || num >= indxOfNum.size() || indxOfNum[num] < 0) return -1;
+   return FAULT_ID(indxOfNum[num], stoi(value_buf) & 1);
+}
 
 int podem (char *cp) {
-   podem_recursion_tStart = clock();
    char faultNode_buf[MAXLINE], faultValue_buf[MAXLINE];
    sscanf(cp, "%s %s", faultNode_buf, faultValue_buf);
 
-   int faultNode = stoi(faultNode_buf);
-   int faultValue = stoi(faultValue_buf);
-   
-   // set all gate values to X
-   for (int i=0; i < Nnodes; i++) {
-      Node[i].fault = NOFAULT;
-      Node[i].value = LOGIC_X;
-      if (Node[i].num == faultNode) {
-         faultLocation = &Node[i];
-         Node[i].fault = faultValue;
-         faultActivationVal = (faultValue == FAULT_SA0) ? LOGIC_1 : LOGIC_0;
-      }
+   int fault = faultArg(faultNode_buf, faultValue_buf);
+   if (fault < 0) {
+      cout << "invalid argument" << endl;
+      return 1;
    }
-
-   // initialize the D frontier.
-   dFrontier.clear();
-
-   // call PODEM recursion function
-   bool res = podemRecursion();
+   SearchState S(circuit);
+   int res = podemGenerate(circuit, S, fault);
 
    // If success, print the test to the output file.
-   int initial = 0; 
-   if (res == true) {
-   //   try {
-   //       //std::regex rgx("(a-zA-Z0-9_+)\\.ckt");
-   //       regex rgx(R"(([\w]+)\.ckt)");
-   //    } catch (std::regex_error& e) {
-   //       cout << e.code() << endl;
-   //       if (e.code() == std::regex_constants::error_brack	)
-   //          std::cerr << "The expression contained mismatched brackets ([ and ]).\n";
-   //       else std::cerr << "Some other regex exception happened.\n";
-   //    }
-   //    regex rgx(R"(([\w]+)\.ckt)");
-   //    smatch match;
-   //    circuitName = "/home/viterbi/02/sgadde/ee658/ee658/circuits/c17.ckt";
-   //    cout << circuitName << endl;
-   //    if (regex_search(circuitName, match, rgx)){ 
-   //       cout << "FOUND" << endl; 
-   //       for ( auto i : match ){
-   //          cout << i << "," ;}
-   //       cout << match[0] << endl;
-         string output_file = circuitName + "_PODEM_" + faultNode_buf + "@" + faultValue_buf + ".txt";
-         ofstream output_test_pattern_file;
-         output_test_pattern_file.open(output_file);
-         if ( output_test_pattern_file ) {
-            for (int i = 0; i < Nnodes; i++) {
-               if (Node[i].fin == 0) {
-                  if (initial == 1) {
-                              output_test_pattern_file << ",";
-                  }
-                           output_test_pattern_file << Node[i].num;
-                  initial = 1;
-               }
-            }
-            output_test_pattern_file << endl;
-            initial = 0;
-            for (int i = 0; i < Nnodes; i++) {
-               if (Node[i].fin == 0) {
-                  if (initial == 1) {
-                           output_test_pattern_file << ",";
-                  }
-                  if (Node[i].value == LOGIC_X) {
-                           output_test_pattern_file << "X";
-                  } else if (Node[i].value == LOGIC_D) {
-                           output_test_pattern_file << "1";
-                  } else if (Node[i].value == LOGIC_DBAR) {
-                           output_test_pattern_file << "0";
-                  } else {
-                           output_test_pattern_file << Node[i].value;
-                  }
-                  initial = 1;
-               }
-            }
-            output_test_pattern_file << endl;
-         }
-         output_test_pattern_file.close();
+   if (res == ATPG_DETECTED) {
+      writeTestCube(circuitName + "_PODEM_" + faultNode_buf + "@" + faultValue_buf + ".txt", atpgTestCube(S));
    }
 
-   // If failure to find test, print a message to the output file
-   else {
-      //cout << "none found" << endl;
-      return 1;
+   // If failure to find test, return why (ATPG_UNTESTABLE or ATPG_ABORTED)
+   return res;
+}
+
+/** @brief PODEM for the fault at site stuck-at stuck, keeping the PIs that cube assigns.
+ * \param cube Values of Pinput[0..Npi-1], LOGIC_X where the PI is still free.
+ *
+ * The assigned PIs are implied before the search starts, so its decisions
+ * only ever go to the free ones. Used by dynamic compaction: there is no SAT
+ * fallback and no output file. \returns like podemSearch; on ATPG_DETECTED
+ * the PI values hold cube extended with a test for the fault.
+ */
+int podemConstrained(SearchState &S, NSTRUC* site, int stuck, const vector<int> &cube) {
+   podemReset(S, site, stuck);
+   for (int i = 0; i < S.C.npi; i++) {
+      if (cube[i] != LOGIC_X) podemImply(S, S.C.pi[i], cube[i]);
    }
+   return podemSearch(S);
+}
 
-   return 0;
+/** @brief The test cube left in the PI values of S, in Pinput order: D and DBAR become 1 and 0, X stays LOGIC_X. */
+vector<int> atpgTestCube(SearchState &S) {
+   vector<int> cube(S.C.npi);
+   for (int i = 0; i < S.C.npi; i++) {
+      int v = S[S.C.pi[i]].value;
+      if (v == LOGIC_D) v = LOGIC_1;
+      else if (v == LOGIC_DBAR) v = LOGIC_0;
+      cube[i] = v;
+   }
+   return cube;
+}
+
+/** @brief Write a test cube (in Pinput order): the PI numbers, then their values (X if unassigned).
+ */
+void writeTestCube(string output_file, const vector<int> &cube) {
+   ofstream output_test_pattern_file;
+   output_test_pattern_file.open(output_file);
+   if ( output_test_pattern_file ) {
+      for (int i = 0; i < Npi; i++) {
+         output_test_pattern_file << (i ? "," : "") << Pinput[i]->num;
+      }
+      output_test_pattern_file << endl;
+      for (int i = 0; i < Npi; i++) {
+         output_test_pattern_file << (i ? "," : "");
+         if (cube[i] == LOGIC_X) {
+            output_test_pattern_file << "X";
+         } else {
+            output_test_pattern_file << cube[i];
+         }
+      }
+      output_test_pattern_file << endl;
+   }
+   output_test_pattern_file.close();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -1540,16 +2470,16 @@ int podem (char *cp) {
  * Full-circuit simulation: set all non-PI gates to LOGIC_UNSET
  * and call the recursive simulate function on all PO gates.
  */
-void simFullCircuit() {
-  for (int i=0; i<Nnodes; i++) {
-    NSTRUC* g = &Node[i];
+void simFullCircuit(SearchState &S) {
+  for (int i=0; i<S.C.nnodes; i++) {
+    NSTRUC* g = &S.C.node[i];
     if (g->type != GATE_PI)
-      g->value = LOGIC_UNSET;      
+      S[g].value = LOGIC_UNSET;      
   }  
-  for (int i=0; i<Nnodes; i++) {
-   NSTRUC* g = &Node[i];
+  for (int i=0; i<S.C.nnodes; i++) {
+   NSTRUC* g = &S.C.node[i];
    if (g->fout == 0) {
-      simGateRecursive(g);
+      simGateRecursive(S, g);
    }
   }
 }
@@ -1567,196 +2497,584 @@ void simFullCircuit() {
  * the calculated value.
  * 
  */
-void simGateRecursive(NSTRUC* g) {
+void simGateRecursive(SearchState &S, NSTRUC* g) {
 
   // If this gate has an already-set value, then we're done.
-  if (g->value != LOGIC_UNSET)
+  if (S[g].value != LOGIC_UNSET)
     return;
   
   // Recursively call this function on this gate's predecessors to
   // ensure that their values are known.
   for (int i=0; i<g->fin; i++) {
-    simGateRecursive(g->unodes[i]);
+    simGateRecursive(S, g->unodes[i]);
   }
   
-  int gateValue = simGate(g);
+  int gateValue = simGate(S, g);
 
   // After I have calculated this gate's value, check to see if a fault changes it and set.
-  setValueCheckFault(g, gateValue);
+  setValueCheckFault(S, g, gateValue);
+}
+
+/* Five-valued logic tables.
+ *
+ * A value is kept as a pair (good, faulty) of three-valued rails, each 0, 1 or
+ * 2 (= X), packed into the code 3*good + faulty. Folding a gate over its inputs
+ * on these pairs gives the same result as the D-calculus (e.g. D AND D' AND X
+ * is 0) with no temporary vectors; the result is collapsed back to the LOGIC_*
+ * values at the end. All tables are generated at compile time.
+ */
+#define RAIL_X 2
+#define LOGIC_CODES 9
+
+constexpr int railAnd(int a, int b) { return (a == 0 || b == 0) ? 0 : (a == 1 && b == 1) ? 1 : RAIL_X; }
+constexpr int railOr(int a, int b) { return (a == 1 || b == 1) ? 1 : (a == 0 && b == 0) ? 0 : RAIL_X; }
+constexpr int railXor(int a, int b) { return (a == RAIL_X || b == RAIL_X) ? RAIL_X : (a ^ b); }
+constexpr int railNot(int a) { return (a == RAIL_X) ? RAIL_X : 1 - a; }
+
+struct logicTable { unsigned char v[LOGIC_CODES][LOGIC_CODES]; };
+struct logicMap { unsigned char v[LOGIC_CODES]; };
+
+// op: 0 = AND, 1 = OR, 2 = XOR
+constexpr logicTable makeLogicTable(int op) {
+  logicTable t = {};
+  for (int a = 0; a < LOGIC_CODES; a++) {
+    for (int b = 0; b < LOGIC_CODES; b++) {
+      int ga = a / 3, fa = a % 3, gb = b / 3, fb = b % 3;
+      int g = (op == 0) ? railAnd(ga, gb) : (op == 1) ? railOr(ga, gb) : railXor(ga, gb);
+      int f = (op == 0) ? railAnd(fa, fb) : (op == 1) ? railOr(fa, fb) : railXor(fa, fb);
+      t.v[a][b] = 3 * g + f;
+    }
+  }
+  return t;
+}
+
+constexpr logicMap makeNotTable() {
+  logicMap t = {};
+  for (int a = 0; a < LOGIC_CODES; a++) t.v[a] = 3 * railNot(a / 3) + railNot(a % 3);
+  return t;
+}
+
+// LOGIC_* value of a code: X unless both rails are known
+constexpr int codeLogic(int code) {
+  return (code / 3 == RAIL_X || code % 3 == RAIL_X) ? LOGIC_X
+       : (code / 3 == code % 3) ? code / 3
+       : (code / 3 == 1) ? LOGIC_D : LOGIC_DBAR;
+}
+
+constexpr logicMap makeCodeToLogic() {
+  logicMap t = {};
+  for (int a = 0; a < LOGIC_CODES; a++) t.v[a] = (unsigned char) (codeLogic(a) + 1);   // stored as LOGIC_* + 1
+  return t;
 }
 
+constexpr logicTable AND_TABLE = makeLogicTable(0);
+constexpr logicTable OR_TABLE = makeLogicTable(1);
+constexpr logicTable XOR_TABLE = makeLogicTable(2);
+constexpr logicMap NOT_TABLE = makeNotTable();
+constexpr logicMap CODE_TO_LOGIC = makeCodeToLogic();
+// code of LOGIC_X, LOGIC_0, LOGIC_1, LOGIC_D, LOGIC_DBAR, LOGIC_UNSET (indexed by value + 1)
+constexpr unsigned char LOGIC_TO_CODE[6] = {3 * RAIL_X + RAIL_X, 0, 4, 3, 1, 3 * RAIL_X + RAIL_X};
+constexpr unsigned char CODE_0 = 0, CODE_1 = 4;
+
+inline int logicCode(int logicVal) { return LOGIC_TO_CODE[logicVal + 1]; }
+inline int codeToLogic(int code) { return (int) CODE_TO_LOGIC.v[code] - 1; }
+
 /** @brief Simulate the value of the given Gate.
  *
  * This is a gate simulation function -- it will simulate the gate g
  * with its current input values and return the output value.
  * This function does not deal with the fault. (That comes later.)
  *
+ * The inputs are folded in place through the five-valued tables above,
+ * stopping early once the output is fixed by a controlling value.
  */
-int simGate(NSTRUC* g) {
-  // Create a vector of the values of this gate's inputs.
-  vector<int> inputVals;
-  for (int i=0; i<g->fin; i++) {
-    inputVals.push_back(g->unodes[i]->value);      
-  }
-
-  int gateType = g->type;
-  int gateValue;
-  // Now, set the value of this gate based on its logical function and its input values
-  switch(gateType) {   
-  case GATE_NAND: { gateValue = evalGate(inputVals, 0, 1); break; }
-  case GATE_NOR: { gateValue = evalGate(inputVals, 1, 1); break; }
-  case GATE_AND: { gateValue = evalGate(inputVals, 0, 0); break; }
-  case GATE_OR: { gateValue = evalGate(inputVals, 1, 0); break; }
-  case GATE_NOT: { gateValue = LogicNot(inputVals[0]); break; }
-  case GATE_XOR: { gateValue = EvalXORGate(inputVals, 0); break; }
-  case GATE_BRANCH: {gateValue = inputVals[0]; break; }
-  default: break;//{ cout << "ERROR: Do not know how to evaluate gate type " << gateType << endl; assert(false);}
+int simGate(SearchState &S, NSTRUC* g) {
+  int acc;
+  switch(g->type) {   
+  case GATE_BRANCH: return S[g->unodes[0]].value;
+  case GATE_NOT: return codeToLogic(NOT_TABLE.v[logicCode(S[g->unodes[0]].value)]);
+  case GATE_AND:
+  case GATE_NAND:
+    acc = CODE_1;
+    for (int i=0; i<g->fin && acc != CODE_0; i++) acc = AND_TABLE.v[acc][logicCode(S[g->unodes[i]].value)];
+    return codeToLogic((g->type == GATE_NAND) ? NOT_TABLE.v[acc] : acc);
+  case GATE_OR:
+  case GATE_NOR:
+    acc = CODE_0;
+    for (int i=0; i<g->fin && acc != CODE_1; i++) acc = OR_TABLE.v[acc][logicCode(S[g->unodes[i]].value)];
+    return codeToLogic((g->type == GATE_NOR) ? NOT_TABLE.v[acc] : acc);
+  case GATE_XOR:
+    acc = CODE_0;
+    for (int i=0; i<g->fin; i++) acc = XOR_TABLE.v[acc][logicCode(S[g->unodes[i]].value)];
+    return codeToLogic(acc);
+  default: break;
   }    
+  return S[g].value;
+}
 
-  return gateValue;
+
+/** @brief Perform a logical NOT operation on a logical value using the LOGIC_* macros
+ */
+int LogicNot(int logicVal) {
+  return codeToLogic(NOT_TABLE.v[logicCode(logicVal)]);
 }
 
-/** @brief Evaluate a NAND, NOR, AND, or OR gate.
- * \param in The logic value's of this gate's inputs.
- * \param c The controlling value of this gate type (e.g. c==0 for an AND or NAND gate)
- * \param i The inverting value for this gate (e.g. i==0 for AND and i==1 for NAND)
- * \returns The logical value produced by this gate (not including a possible fault on this gate).
+
+/** @brief Set the value of Gate* g to value gateValue, accounting for any fault on g.
  */
-int evalGate(vector<int> in, int c, int i) {
+void setValueCheckFault(SearchState &S, NSTRUC* g, int gateValue) {
+  S[g].value = applyFault(S, g, gateValue);
+}
 
-  // Are any of the inputs of this gate the controlling value?
-  bool anyC = find(in.begin(), in.end(), c) != in.end();
-  
-  // Are any of the inputs of this gate unknown?
-  bool anyUnknown = (find(in.begin(), in.end(), LOGIC_X) != in.end());
+/** @brief The value of Gate* g when its inputs give gateValue, accounting for any fault on g.
+ */
+int applyFault(SearchState &S, NSTRUC* g, int gateValue) {
+  if ((S[g].fault == FAULT_SA0) && (gateValue == LOGIC_1)) 
+  	return LOGIC_D;
+  else if ((S[g].fault == FAULT_SA0) && (gateValue == LOGIC_DBAR)) 
+  	return LOGIC_0;
+  else if ((S[g].fault == FAULT_SA1) && (gateValue == LOGIC_0)) 
+  	return LOGIC_DBAR;
+  else if ((S[g].fault == FAULT_SA1) && (gateValue == LOGIC_D)) 
+  	return LOGIC_1;
+  return gateValue;
+}
 
-  int anyD    = find(in.begin(), in.end(), LOGIC_D)    != in.end();
-  int anyDBar = find(in.begin(), in.end(), LOGIC_DBAR) != in.end();
 
+/** @brief Set the value of Gate* g (accounting for its fault) and record the change.
+ *
+ * If the value changes, the old value is pushed on podemTrail and the fanout
+ * gates of g are scheduled in eventQueue at their level.
+ */
+void podemSetValue(SearchState &S, NSTRUC* g, int gateValue) {
+  int oldValue = S[g].value;
+  setValueCheckFault(S, g, gateValue);
+  if (S[g].value == oldValue)
+    return;
 
-  // if any input is c or we have both D and D', then return c^i
-  if ((anyC) || (anyD && anyDBar))
-    return (i) ? LogicNot(c) : c;
-  
-  // else if any input is unknown, return unknown
-  else if (anyUnknown)
-    return LOGIC_X;
-
-  // else if any input is D, return D^i
-  else if (anyD)
-    return (i) ? LOGIC_DBAR : LOGIC_D;
-
-  // else if any input is D', return D'^i
-  else if (anyDBar)
-    return (i) ? LOGIC_D : LOGIC_DBAR;
-
-  // else return ~(c^i)
-  else
-    return LogicNot((i) ? LogicNot(c) : c);
-}
-
-/** @brief Evaluate an XOR or XNOR gate.
- * \param in The logic value's of this gate's inputs.
- * \param inv The inverting value for this gate (e.g. i==0 for XOR and i==1 for XNOR)
- * \returns The logical value produced by this gate (not including a possible fault on this gate).
- */
-int EvalXORGate(vector<int> in, int inv) {
-
-  // if any unknowns, return unknown
-  bool anyUnknown = (find(in.begin(), in.end(), LOGIC_X) != in.end());
-  if (anyUnknown)
-    return LOGIC_X;
-
-  // Otherwise, let's count the numbers of ones and zeros for faulty and fault-free circuits.
-  int onesFaultFree = 0;
-  int onesFaulty = 0;
-
-  for (int i=0; i<in.size(); i++) {
-    switch(in[i]) {
-    case LOGIC_0: {break;}
-    case LOGIC_1: {onesFaultFree++; onesFaulty++; break;}
-    case LOGIC_D: {onesFaultFree++; break;}
-    case LOGIC_DBAR: {onesFaulty++; break;}
-    default: {cout << "ERROR: Do not know how to process logic value " << in[i] << " in Gate::EvalXORGate()" << endl; return LOGIC_X;}
+  S.podemTrail.push_back(make_pair(g, oldValue));
+  dFrontierUpdate(S, g);
+  for (int i=0; i<g->fout; i++) {
+    NSTRUC* d = g->dnodes[i];
+    dFrontierUpdate(S, d);
+    if (!S[d].queued) {
+      S[d].queued = 1;
+      S.eventQueue[d->level].push_back(d);
     }
   }
-  
-  int XORVal;
+}
+
+/** @brief Event-driven implication of one PI assignment (PODEM imply).
+ * \param g The primary input being assigned.
+ * \param val The value assigned to it.
+ *
+ * Only the gates whose inputs actually changed are re-evaluated, level by level,
+ * so the cost is proportional to the part of the fanout cone of g that changes
+ * instead of the whole circuit.
+ */
+void podemImply(SearchState &S, NSTRUC* g, int val) {
+  podemSetValue(S, g, val);
+
+  for (int lvl = g->level + 1; lvl <= S.C.maxLevel; lvl++) {
+    vector<NSTRUC *> &bucket = S.eventQueue[lvl];
+    // gates are only ever scheduled at a higher level than the one being evaluated
+    for (int i=0; i<bucket.size(); i++) {
+      NSTRUC* np = bucket[i];
+      S[np].queued = 0;
+      podemSetValue(S, np, simGate(S, np));
+    }
+    bucket.clear();
+  }
+}
+
+/** @brief Undo every value change recorded after trail position mark.
+ */
+void podemUndo(SearchState &S, size_t mark) {
+  while (S.podemTrail.size() > mark) {
+    NSTRUC* g = S.podemTrail.back().first;
+    S[g].value = S.podemTrail.back().second;
+    S.podemTrail.pop_back();
+    dFrontierUpdate(S, g);
+    for (int i=0; i<g->fout; i++) dFrontierUpdate(S, g->dnodes[i]);
+  }
+}
+
 
-   if ((onesFaultFree%2 == 0) && (onesFaulty%2 ==0)) { 
-      XORVal = LOGIC_0; }
-   else if ((onesFaultFree%2 == 1) && (onesFaulty%2 ==1))
-    { XORVal = LOGIC_1; }
-  else if ((onesFaultFree%2 == 1) && (onesFaulty%2 ==0))
-   { XORVal = LOGIC_D; }
-  else
-   { XORVal = LOGIC_DBAR; }
+/* Dual-rail bit-parallel five-valued algebra.
+ *
+ * A drword holds the good and the faulty machine as two bit-planes, each with
+ * a validity mask for X, so D = (1,0), D' = (0,1), and bit k of every plane is
+ * an independent lane k. The gate operators are plain word operations on the
+ * rails and agree lane by lane with the five-valued tables above; one pass over
+ * a cone therefore evaluates up to 64 alternatives at once. A value bit is
+ * always 0 where its validity bit is 0.
+ */
+const uint64_t DR_ALL = ~(uint64_t) 0;
+
+inline drword drAnd(drword a, drword b) {
+  drword r;
+  r.g = a.g & b.g;
+  r.gv = (a.gv & b.gv) | (a.gv & ~a.g) | (b.gv & ~b.g);
+  r.f = a.f & b.f;
+  r.fv = (a.fv & b.fv) | (a.fv & ~a.f) | (b.fv & ~b.f);
+  return r;
+}
 
-  return (inv) ? LogicNot(XORVal) : XORVal;
+inline drword drOr(drword a, drword b) {
+  drword r;
+  r.g = a.g | b.g;
+  r.gv = (a.gv & b.gv) | r.g;
+  r.f = a.f | b.f;
+  r.fv = (a.fv & b.fv) | r.f;
+  return r;
+}
 
+inline drword drXor(drword a, drword b) {
+  drword r;
+  r.gv = a.gv & b.gv;
+  r.g = (a.g ^ b.g) & r.gv;
+  r.fv = a.fv & b.fv;
+  r.f = (a.f ^ b.f) & r.fv;
+  return r;
 }
 
+inline drword drNot(drword a) {
+  drword r = {~a.g & a.gv, a.gv, ~a.f & a.fv, a.fv};
+  return r;
+}
 
-/** @brief Perform a logical NOT operation on a logical value using the LOGIC_* macros
+// lanes whose LOGIC_* value is X (either machine unknown)
+inline uint64_t drUnknown(drword w) { return ~(w.gv & w.fv); }
+// lanes holding D or D'
+inline uint64_t drFaultEffect(drword w) { return w.gv & w.fv & (w.g ^ w.f); }
+// lanes in which two words differ
+inline uint64_t drDiff(drword a, drword b) { return (a.g ^ b.g) | (a.gv ^ b.gv) | (a.f ^ b.f) | (a.fv ^ b.fv); }
+
+/** @brief A LOGIC_* value copied into every lane.
  */
-int LogicNot(int logicVal) {
-  if (logicVal == LOGIC_1)
-    return LOGIC_0;
-  if (logicVal == LOGIC_0)
-    return LOGIC_1;
-  if (logicVal == LOGIC_D)
-    return LOGIC_DBAR;
-  if (logicVal == LOGIC_DBAR)
-    return LOGIC_D;
-  if (logicVal == LOGIC_X)
-    return LOGIC_X;
-      
-  cout << "ERROR: Do not know how to invert " << logicVal << " in LogicNot(int logicVal)" << endl;
-  return LOGIC_UNSET;
+drword drFromLogic(int logicVal) {
+  // indexed by LOGIC_* + 1: X, 0, 1, D, D', unset
+  static const drword DR_FROM_LOGIC[6] = {
+    {0, 0, 0, 0},
+    {0, DR_ALL, 0, DR_ALL},
+    {DR_ALL, DR_ALL, DR_ALL, DR_ALL},
+    {DR_ALL, DR_ALL, 0, DR_ALL},
+    {0, DR_ALL, DR_ALL, DR_ALL},
+    {0, 0, 0, 0}
+  };
+  return DR_FROM_LOGIC[logicVal + 1];
 }
 
+/** @brief The word of Gate* g in the current speculative pass: its lane values if
+ * the pass reached it, its committed value otherwise.
+ */
+drword drInput(SearchState &S, NSTRUC* g) {
+  return (S[g].drstamp == S.drStamp) ? S[g].dr : drFromLogic(S[g].value);
+}
 
-/** @brief Set the value of Gate* g to value gateValue, accounting for any fault on g.
+/** @brief Bit-parallel counterpart of simGate: evaluate Gate* g in every lane.
+ */
+drword drSimGate(SearchState &S, NSTRUC* g) {
+  drword acc;
+  switch(g->type) {
+  case GATE_BRANCH: return drInput(S, g->unodes[0]);
+  case GATE_NOT: return drNot(drInput(S, g->unodes[0]));
+  case GATE_AND:
+  case GATE_NAND:
+    acc = drFromLogic(LOGIC_1);
+    for (int i=0; i<g->fin; i++) acc = drAnd(acc, drInput(S, g->unodes[i]));
+    return (g->type == GATE_NAND) ? drNot(acc) : acc;
+  case GATE_OR:
+  case GATE_NOR:
+    acc = drFromLogic(LOGIC_0);
+    for (int i=0; i<g->fin; i++) acc = drOr(acc, drInput(S, g->unodes[i]));
+    return (g->type == GATE_NOR) ? drNot(acc) : acc;
+  case GATE_XOR:
+    acc = drFromLogic(LOGIC_0);
+    for (int i=0; i<g->fin; i++) acc = drXor(acc, drInput(S, g->unodes[i]));
+    return acc;
+  default: break;
+  }
+  return drInput(S, g);
+}
+
+/** @brief Bit-parallel counterpart of setValueCheckFault: a stuck-at fault on g
+ * fixes its faulty-machine rail in every lane.
+ */
+drword drApplyFault(SearchState &S, NSTRUC* g, drword w) {
+  if (S[g].fault == FAULT_SA0) {
+    w.f = 0;
+    w.fv = DR_ALL;
+  }
+  else if (S[g].fault == FAULT_SA1) {
+    w.f = w.fv = DR_ALL;
+  }
+  return w;
+}
+
+// lanes used by podemSpeculate: lane 0 holds pi = 0, lane 1 pi = 1
+const uint64_t DR_SPEC_LANES = 3;
+
+/** @brief Store word w (after the fault on np) as the speculative value of np and,
+ * if it differs from the committed value in a speculative lane, schedule the fanout gates.
+ */
+void drSetValue(SearchState &S, NSTRUC* np, drword w) {
+  S[np].dr = drApplyFault(S, np, w);
+  S[np].drstamp = S.drStamp;
+  if ((drDiff(S[np].dr, drFromLogic(S[np].value)) & DR_SPEC_LANES) == 0)
+    return;
+
+  for (int j=0; j<np->fout; j++) {
+    NSTRUC* d = np->dnodes[j];
+    if (!S[d].queued) {
+      S[d].queued = 1;
+      S.eventQueue[d->level].push_back(d);
+    }
+  }
+}
+
+/** @brief Imply both values of a backtraced PI in one pass, in lanes 0 (pi = 0) and 1 (pi = 1).
+ * \param pi The primary input picked by backtrace (currently X).
+ * \param detectMask Output: bit v is set if the pass saw pi = v put D or D' on a primary output.
+ * \returns A mask with bit v set if pi = v can still lead to a test, i.e. the
+ * fault site is not blocked and, once excited, the fault effect is either
+ * observed or still has a D frontier.
+ *
+ * Only the part of the fanout cone of pi that changes is evaluated, level by
+ * level through eventQueue, and the pass stops as soon as the fault site is
+ * settled and every lane it leaves alive is known to be open; the committed
+ * values, the trail and dFrontier are left untouched.
  */
-void setValueCheckFault(NSTRUC* g, int gateValue) {
-  if ((g->fault == FAULT_SA0) && (gateValue == LOGIC_1)) 
-  	g->value = LOGIC_D;
-  else if ((g->fault == FAULT_SA0) && (gateValue == LOGIC_DBAR)) 
-  	g->value = LOGIC_0;
-  else if ((g->fault == FAULT_SA1) && (gateValue == LOGIC_0)) 
-  	g->value = LOGIC_DBAR;
-  else if ((g->fault == FAULT_SA1) && (gateValue == LOGIC_D)) 
-  	g->value = LOGIC_1;
-  else
-  	g->value = gateValue;
+int podemSpeculate(SearchState &S, NSTRUC* pi, int &detectMask) {
+  uint64_t frontier = 0, detected = 0, open = 0;
+  S.drStamp++;
+
+  drword w = {2, DR_SPEC_LANES, 2, DR_SPEC_LANES};
+  drSetValue(S, pi, w);
+  if (pi->po) detected |= drFaultEffect(S[pi].dr);
+
+  for (int lvl = pi->level; lvl <= S.C.maxLevel; lvl++) {
+    vector<NSTRUC *> &bucket = S.eventQueue[lvl];
+    for (int i=0; i<bucket.size(); i++) {
+      NSTRUC* np = bucket[i];
+      S[np].queued = 0;
+      drSetValue(S, np, drSimGate(S, np));
+      if (np->po) detected |= drFaultEffect(S[np].dr);
+
+      if (drUnknown(S[np].dr) & DR_SPEC_LANES) {
+        uint64_t faultIn = 0;
+        for (int j=0; j<np->fin; j++) faultIn |= drFaultEffect(drInput(S, np->unodes[j]));
+        frontier |= drUnknown(S[np].dr) & faultIn;
+      }
+    }
+    bucket.clear();
+
+    if (lvl < S.faultLocation->level) continue;
+
+    // D-frontier gates up to this level that the pass did not reach keep their place in both lanes
+    for (int i=0; i<S.dFrontier.size() && frontier != DR_SPEC_LANES; i++) {
+      if (S.dFrontier[i]->level <= lvl && S[S.dFrontier[i]].drstamp != S.drStamp) frontier = DR_SPEC_LANES;
+    }
+    drword site = drInput(S, S.faultLocation);
+    uint64_t alive = (drUnknown(site) | drFaultEffect(site)) & DR_SPEC_LANES;
+    open = (drUnknown(site) | (drFaultEffect(site) & (frontier | detected))) & DR_SPEC_LANES;
+    if (open == alive && lvl < S.C.maxLevel) {
+      // nothing further up can change the answer: drop the pending events
+      for (int l = lvl + 1; l <= S.C.maxLevel; l++) {
+        for (int i=0; i<S.eventQueue[l].size(); i++) S[S.eventQueue[l][i]].queued = 0;
+        S.eventQueue[l].clear();
+      }
+      break;
+    }
+  }
+
+  detectMask = (int) (detected & DR_SPEC_LANES);
+  return (int) open;
+}
+
+/** @brief Good-machine component of a five-valued value (LOGIC_0, LOGIC_1 or LOGIC_X).
+ */
+int goodValue(int logicVal) {
+  if (logicVal == LOGIC_D) return LOGIC_1;
+  if (logicVal == LOGIC_DBAR) return LOGIC_0;
+  if (logicVal == LOGIC_0 || logicVal == LOGIC_1) return logicVal;
+  return LOGIC_X;
+}
+
+/** @brief Stamp the fanout cone of the fault site with a new coneStamp.
+ *
+ * Outside the cone the faulty machine equals the good machine, so a learned
+ * (good-machine) implication may assign a binary value there.
+ */
+void markFaultCone(SearchState &S, NSTRUC* site) {
+  S.coneStamp++;
+  vector<NSTRUC *> stack(1, site);
+  S[site].fcone = S.coneStamp;
+  while (!stack.empty()) {
+    NSTRUC* g = stack.back();
+    stack.pop_back();
+    for (int i=0; i<g->fout; i++) {
+      if (S[g->dnodes[i]].fcone != S.coneStamp) {
+        S[g->dnodes[i]].fcone = S.coneStamp;
+        stack.push_back(g->dnodes[i]);
+      }
+    }
+  }
+}
+
+/** @brief Does the static learning contradict Gate* g taking good value v?
+ *
+ * True if some implication learned for g = v requires a good value that is
+ * already the opposite one.
+ */
+bool learnConflict(SearchState &S, NSTRUC* g, int v) {
+  if (S.C.learnStart == NULL) return false;
+  int lit = 2 * g->indx + v;
+  for (int i = S.C.learnStart[lit]; i < S.C.learnStart[lit + 1]; i++) {
+    int m = goodValue(S.node[S.C.learnTarget[i] >> 1].value);
+    if (m != LOGIC_X && m != (S.C.learnTarget[i] & 1)) return true;
+  }
+  return false;
 }
 
+/** @brief PODEM conflict check of the objective (g, v) against the static learning.
+ *
+ * Only objectives that every test must meet are checked: fault activation, and
+ * the side inputs of the only D-frontier gate. If such an objective contradicts
+ * the learned implications, the current PI assignment cannot lead to a test.
+ */
+bool podemLearnBlocked(SearchState &S, NSTRUC* g, int v) {
+  if (g == S.faultLocation) return learnConflict(S, g, v);
+  if (S.dFrontier.size() == 1 && S.dFrontier[0]->type != GATE_XOR) return learnConflict(S, g, v);
+  return false;
+}
 
 // End of functions for circuit simulation
 ////////////////////////////////////////////////////////////
-/** @brief A simple method to compute the set of gates on the D frontier.
+/** @brief Keep the D frontier up to date for Gate* g after a value change on g or on one of its inputs.
+ *
+ * dFrontier is an indexed set: g->dfpos is the position of g in the vector
+ * (or -1), so membership tests, insertion and removal are all O(1).
  */
-void updateDFrontier() {
-  //  - clear the dFrontier vector (stored as the global variable dFrontier -- see the top of the file)
-	dFrontier.clear();
-	
-  //  - loop over all gates in the circuit; for each gate, check if it should be on D-frontier; if it is, add it to the dFrontier vector.
-	NSTRUC* np;
-
-	for (int i=0; i< Nnodes; i++)	{
-		np = &Node[i];
-		if (np->value != LOGIC_X) {continue; }
-		else {
-			for (int j=0; j<np->fin; j++) { 
-            if (np->unodes[j]->value == LOGIC_D || np->unodes[j]->value == LOGIC_DBAR) {
-               dFrontier.push_back(np); 
-               break;
-            }
-         }		
+void dFrontierUpdate(SearchState &S, NSTRUC* g) {
+	bool onFrontier = false;
+	if (S[g].value == LOGIC_X) {
+		for (int j=0; j<g->fin; j++) { 
+			if (S[g->unodes[j]].value == LOGIC_D || S[g->unodes[j]].value == LOGIC_DBAR) {
+				onFrontier = true;
+				break;
+			}
+		}
+	}
+
+	if (onFrontier && S[g].dfpos < 0) {
+		S[g].dfpos = S.dFrontier.size();
+		S.dFrontier.push_back(g);
+	}
+	else if (!onFrontier && S[g].dfpos >= 0) {
+		// move the last gate into the freed slot
+		NSTRUC* last = S.dFrontier.back();
+		S.dFrontier[S[g].dfpos] = last;
+		S[last].dfpos = S[g].dfpos;
+		S.dFrontier.pop_back();
+		S[g].dfpos = -1;
+	}
+}
+
+/** @brief The D-frontier gate with the best (lowest) SCOAP observability, NULL if the frontier is empty.
+ */
+NSTRUC* dFrontierBest(SearchState &S) {
+	NSTRUC* d = NULL;
+	for (int i=0; i<S.dFrontier.size(); i++) {
+		if (d == NULL || S.dFrontier[i]->co < d->co) d = S.dFrontier[i];
+	}
+	return d;
+}
+
+
+/** @brief Is there a path of X nodes from Gate* g (itself X) to a primary output?
+ *
+ * Nodes visited during the current check are stamped with xPathStamp and keep
+ * their result in xpath, so each node is explored at most once per check no
+ * matter how many D-frontier gates reach it.
+ */
+bool xPathFrom(SearchState &S, NSTRUC* g) {
+	if (S[g].xstamp == S.xPathStamp) return S[g].xpath;
+	S[g].xstamp = S.xPathStamp;
+	S[g].xpath = 0;
+
+	if (S[g].value != LOGIC_X) return false;
+	if (g->po || g->fout == 0) {
+		S[g].xpath = 1;
+		return true;
+	}
+	for (int i=0; i<g->fout; i++) {
+		if (xPathFrom(S, g->dnodes[i])) {
+			S[g].xpath = 1;
+			return true;
 		}
 	}
+	return false;
+}
+
+/** @brief X-path check: can the fault effect still reach a primary output?
+ *
+ * Before activation the fault site itself must have an X path; afterwards at
+ * least one D-frontier gate must. When every such path is blocked by binary
+ * values no assignment of the remaining PIs can detect the fault.
+ */
+bool xPathCheck(SearchState &S) {
+	S.xPathStamp++;
+	if (S[S.faultLocation].value == LOGIC_X) return xPathFrom(S, S.faultLocation);
+
+	for (int i=0; i<S.dFrontier.size(); i++) {
+		if (xPathFrom(S, S.dFrontier[i])) return true;
+	}
+	return false;
+}
+
+
+/** @brief Controlling value of a gate, LOGIC_X if it has none.
+ */
+int controllingValue(NSTRUC* g) {
+  if (g->type == GATE_AND || g->type == GATE_NAND) return LOGIC_0;
+  if (g->type == GATE_OR || g->type == GATE_NOR) return LOGIC_1;
+  return LOGIC_X;
+}
+
+/** @brief Unique sensitization: the side inputs of the dominators from Gate* d upwards.
+ * \param d First dominator to sensitize (NULL for none).
+ * \param obj Output: the side inputs that are still X are added with their non-controlling value.
+ * \returns false if a side input already holds its controlling value, or the
+ * static learning rules the non-controlling value out.
+ *
+ * Every path from d to an output passes through these gates, so each of their
+ * inputs outside the fault cone must take its non-controlling value in any test.
+ * Used by PODEM, FAN and DALG.
+ */
+bool sensitizeDominators(SearchState &S, NSTRUC* d, vector<pair<NSTRUC *, int> > &obj) {
+  for (; d != NULL; d = d->idom) {
+    int c = controllingValue(d);
+    if (c == LOGIC_X) continue;
+    for (int i=0; i<d->fin; i++) {
+      NSTRUC* in = d->unodes[i];
+      if (S[in].fcone == S.coneStamp) continue;
+      if (S[in].value == c || learnConflict(S, in, 1 - c)) return false;
+      if (S[in].value == LOGIC_X) obj.push_back(make_pair(in, 1 - c));
+    }
+  }
+  return true;
 }
 
+/** @brief The first dominator common to every D-frontier gate (one of them if the frontier
+ * has a single gate), NULL if their paths only meet at the outputs.
+ */
+NSTRUC* dFrontierDominator(SearchState &S) {
+  if (S.dFrontier.empty()) return NULL;
+  NSTRUC* dom = S.dFrontier[0];
+  for (int i=1; i<S.dFrontier.size() && dom != NULL; i++) dom = domIntersect(dom, S.dFrontier[i]);
+  return dom;
+}
 
 // Find the objective for myCircuit. The objective is stored in g, v.
 /** @brief PODEM objective function.
@@ -1764,7 +3082,7 @@ void updateDFrontier() {
  *  \param v Use this char to store the objective value your function picks.
  *  \returns True if the function is able to determine an objective, and false if it fails.
  */
-bool getObjective(NSTRUC* &g, int &v) {
+bool getObjective(SearchState &S, NSTRUC* &g, int &v) {
 
   // First you will need to check if the fault is activated yet.
   // Note that in the setup above we set up a global variable
@@ -1777,41 +3095,54 @@ bool getObjective(NSTRUC* &g, int &v) {
   // location value is not X, then we have failed to activate 
   // the fault. In this case getObjective should fail and Return false.  
 	
-	if (faultLocation->value == LOGIC_X) {g= faultLocation; v=faultActivationVal; 
+	if (S[S.faultLocation].value == LOGIC_X) {
+		// a side input of a dominator of the site already controlling blocks every path
+		S.sensitizeObj.clear();
+		if (!sensitizeDominators(S, S.faultLocation->idom, S.sensitizeObj)) {return false; }
+		g= S.faultLocation; v=S.faultActivationVal; 
 		return true;}
 	
-	if (faultLocation->value == LOGIC_1 || faultLocation->value == LOGIC_0)
+	if (S[S.faultLocation].value == LOGIC_1 || S[S.faultLocation].value == LOGIC_0)
 	{return false;} 
 	//setValueCheckFault(faultLocation, faultLocation->getValue());
 
   // If the fault is already activated, then you will need to 
-  // use the D-frontier to find an objective.
-  // Before you use the D-frontier you should update it by running:
-  updateDFrontier();
+  // use the D-frontier to find an objective. The D-frontier is kept
+  // up to date by the implication (see dFrontierUpdate).
 
-  // If the D frontier is empty after update, then getObjective fails
+  // If the D frontier is empty, then getObjective fails
   // and should return false.
 	
-	if (dFrontier.empty()) {return false; }
+	if (S.dFrontier.empty()) {return false; }
+
+  // Unique sensitization: every propagation path passes through the dominators
+  // common to the whole D frontier, so their side inputs must be non-controlling.
+  // Fail if one is already controlling, otherwise aim at the first one still X.
+	S.sensitizeObj.clear();
+	if (!sensitizeDominators(S, dFrontierDominator(S), S.sensitizeObj)) {return false; }
+	if (!S.sensitizeObj.empty()) {g = S.sensitizeObj[0].first; v = S.sensitizeObj[0].second; 
+		return true;}
 	
   // getObjective needs to choose a gate from the D-Frontier.
-	NSTRUC* d;	
-	d = dFrontier[0];
-	// Later, a possible optimization is to use the SCOAP observability metric or other smart methods to choose this carefully.
+  // Take the most observable one (lowest SCOAP CO).
+	NSTRUC* d = dFrontierBest(S);
     
-  // Lastly, set the values of g and v based on the gate you chose from the D-Frontier.
+	if (d->type == GATE_AND || d->type == GATE_NAND) {v=LOGIC_1; }
+	else if (d->type == GATE_OR || d->type == GATE_NOR) {v=LOGIC_0; }
+	else if (d->type == GATE_XOR) {v=LOGIC_0; }
+	else {v=LOGIC_X; }
+	
+  // Lastly, set g to the X input of that gate that is hardest to set to v:
+  // all of them have to be set eventually, so a conflict is found sooner.
+   g = NULL;
    for (int i=0; i<d->fin; i++) 
       {
-         if (d->unodes[i]->value == LOGIC_X)
+         NSTRUC* in = d->unodes[i];
+         if (S[in].value == LOGIC_X)
          {
-            g = d->unodes[i]; break;
+            if (g == NULL || ((v == LOGIC_0) ? in->cc0 > g->cc0 : in->cc1 > g->cc1)) g = in;
          }
       }
-			
-	if (d->type == GATE_AND || d->type == GATE_NAND) {v=LOGIC_1; }
-	else if (d->type == GATE_OR || d->type == GATE_NOR) {v=LOGIC_0; }
-	else if (d->type == GATE_XOR) {v=LOGIC_0; }
-	else {v=LOGIC_X; }
 	
   return true;
 
@@ -1825,926 +3156,2097 @@ bool getObjective(NSTRUC* &g, int &v) {
  * \param objGate Input: The objective Gate (computed by getObjective)
  * \param objVal Input: the objective value (computed by getObjective)
  */
-void backtrace(NSTRUC* &pi, int &piVal, NSTRUC* objGate, int objVal) {
+void backtrace(SearchState &S, NSTRUC* &pi, int &piVal, NSTRUC* objGate, int objVal) {
 
 	pi = objGate;
-   int k1;
-	int num_inversions;
-	int gatetype = pi->type;
-	
-	if (gatetype == GATE_NOR || gatetype == GATE_NOT || gatetype == GATE_NAND)
-		num_inversions=1;
-	else num_inversions=0;
+	int v = objVal;
 	
 	while (pi->type != GATE_PI)
 	{ 		
-		for (k1=0; k1<pi->fin; k1++) 
+		int gatetype = pi->type;
+		int c = LOGIC_X;		// controlling value of the gate (X if it has none)
+		if (gatetype == GATE_AND || gatetype == GATE_NAND) c = LOGIC_0;
+		else if (gatetype == GATE_OR || gatetype == GATE_NOR) c = LOGIC_1;
+
+		// value needed on the chosen input
+		if (gatetype == GATE_NOR || gatetype == GATE_NOT || gatetype == GATE_NAND)
+			v = LogicNot(v);
+
+		// If one input at the controlling value is enough, follow the easiest X input (lowest SCOAP CC).
+		// If all inputs need the non-controlling value, follow the hardest one first.
+		bool easiest = (c == LOGIC_X || v == c);
+		NSTRUC* next = NULL;
+		int nextCost = 0;
+		for (int k1=0; k1<pi->fin; k1++) 
 			{ 
-				if (pi->unodes[k1]->value == LOGIC_X) {
-               pi=pi->unodes[k1]; break;} 
+				NSTRUC* in = pi->unodes[k1];
+				if (S[in].value != LOGIC_X) continue;
+				int cost = (v == LOGIC_0) ? in->cc0 : in->cc1;
+				if (next == NULL || (easiest ? cost < nextCost : cost > nextCost)) {
+					next = in;
+					nextCost = cost;
+				}
 			}
-			
-			gatetype = pi->type;
-			
-		if (gatetype == GATE_NOR || gatetype == GATE_NOT || gatetype == GATE_NAND)
-		{num_inversions++; }
+		pi = next;
 	}
 	
-	if (num_inversions%2==1) {piVal= LogicNot(objVal); }
-	else {piVal = objVal; }
+	piVal = v;
 	
 }
 
 
-/** @brief PODEM recursion.
+/** @brief Has the search for the current fault used up its budget?
+ * \param backtracks Number of backtracks made so far for this fault.
+ * \param tStart When the search for this fault started.
+ *
+ * The backtrack limit makes results independent of machine load; the
+ * wall-clock budget (settings.seconds) is optional and disabled when 0. A
+ * search cancelled by a PORTFOLIO race counts as out of budget.
  */
-bool podemRecursion() {
+bool atpgBudgetExceeded(SearchState &S, int backtracks, std::chrono::steady_clock::time_point tStart) {
+   if (backtracks > (S.atpgBacktrackCap >= 0 ? S.atpgBacktrackCap : S.settings.backtracks)) return true;
+   if (S.atpgCancel && *S.atpgCancel) return true;
+   if (S.settings.seconds > 0) {
+      const sec elapsed = std::chrono::steady_clock::now() - tStart;
+      if (elapsed.count() > S.settings.seconds) return true;
+   }
+   return false;
+}
 
-   int time_elapsed = (clock() - podem_recursion_tStart)/(CLOCKS_PER_SEC);
-   if (time_elapsed > 1) {
-      return false;
+// A PODEM decision: PI assigned, its current value, whether the other value
+// was already tried, and the trail position to undo to.
+struct podemDecision {
+   NSTRUC* pi;
+   int val;
+   bool flipped;
+   size_t mark;
+};
+
+/** @brief PODEM search.
+ *
+ * Iterative version of the PODEM recursion: the decisions are kept on an explicit
+ * stack instead of the call stack, so deep circuits cannot overflow it.
+ * \returns ATPG_DETECTED if a test was found (the PI values hold the test cube),
+ * ATPG_UNTESTABLE if the search space was exhausted, or ATPG_ABORTED if the
+ * backtrack limit or the time budget was hit first.
+ */
+int podemSearch(SearchState &S) {
+
+  vector<podemDecision> decisions;
+  int backtracks = 0;
+
+  while (true) {
+   if (atpgBudgetExceeded(S, backtracks, S.podem_tStart)) {
+      podemUndo(S, 0);
+      return ATPG_ABORTED;
    }
 
-  // If D or D' is at an output, then return true
-    int i,j,val;
-	
-   for (i = 0; i < Nnodes; i++) {
-      if (Node[i].fout == 0) {
-         val = Node[i].value;
-         if (val == LOGIC_D || val == LOGIC_DBAR) {
-            return true;
-         }
+  // If D or D' is at an output, then we are done
+   for (int i = 0; i < S.C.npo; i++) {
+      int val = S[S.C.po[i]].value;
+      if (val == LOGIC_D || val == LOGIC_DBAR) {
+         return ATPG_DETECTED;
       }
    }
 
    NSTRUC* g;
    int v;  
 
-  // Call the getObjective function. Store the result in g and v.    
-  // If getObjective fails, return false	
-  
-	bool obj = getObjective(g, v);
-	if (obj == false ) return false;
-	
-  NSTRUC* pi;
-  int piVal;
-  
-  // Call the backtrace function. Store the result in pi and piVal.
-  backtrace(pi, piVal, g, v);
-  
-  // Set the value of pi to piVal. Use setValueCheckFault function to make sure if there is a fault on the PI gate, it correctly gets set.
-  setValueCheckFault(pi, piVal);
-  
-  // Now, determine the implications of the input set by simulating the circuit by calling simFullCircuit(myCircuit);
-  simFullCircuit();
-   
-  if (podemRecursion()) {return true;}
-  // If the recursive call fails, set the opposite PI value, simulate it and recurse.
-  // If this recursive call succeeds, return true.
-  int notpiVal;
-  notpiVal= LogicNot(piVal);
-  
-  setValueCheckFault(pi, notpiVal); 
-  
-  simFullCircuit();
-  if (podemRecursion()) {return true;}
-  
-  // If we get to here, neither pi=v nor pi = v' worked. So, set pi to value X and 
-  // return false.
-  setValueCheckFault(pi, LOGIC_X);
+  // If the fault effect can still reach an output, get an objective (g, v)
+  // that the static learning does not rule out, backtrace it to a PI and
+  // imply that PI assignment.
+   if (xPathCheck(S) && getObjective(S, g, v) && !podemLearnBlocked(S, g, v)) {
+      NSTRUC* pi;
+      int piVal;
+      backtrace(S, pi, piVal, g, v);
+
+      // Try both values of pi in one bit-parallel pass: take the other value if
+      // only it detects the fault or only it keeps the search alive, and mark the
+      // decision as flipped when the other value is already known to fail.
+      int detectMask;
+      int openMask = podemSpeculate(S, pi, detectMask);
+      int other = LogicNot(piVal);
+      if ((detectMask & (1 << other)) && !(detectMask & (1 << piVal))) piVal = other;
+      else if (!(openMask & (1 << piVal))) piVal = other;
+
+      if (openMask != 0) {
+         podemDecision d = {pi, piVal, openMask != 3, S.podemTrail.size()};
+         decisions.push_back(d);
+         podemImply(S, pi, piVal);
+         continue;
+      }
+      backtracks++;   // both values fail right away
+   }
 
-  return false;
+  // Otherwise backtrack: drop the decisions whose both values failed, and
+  // try the opposite value of the most recent remaining one.
+   while (!decisions.empty() && decisions.back().flipped) {
+      podemUndo(S, decisions.back().mark);
+      decisions.pop_back();
+   }
+   if (decisions.empty()) {
+      return ATPG_UNTESTABLE;
+   }
+
+   podemDecision &d = decisions.back();
+   podemUndo(S, d.mark);
+   d.flipped = true;
+   d.val = LogicNot(d.val);
+   podemImply(S, d.pi, d.val);
+   backtracks++;
+  }
 }
 
 
-// ------------------------------------- DALG ------------------------------------------------------------------
-deque<int> Dfront;
-vector<int> Jfront;
-vector<int> imply;
-vector< vector<int> > test_vectors;
-int Dalg_count;
-pair<int,int> check_fault;
-clock_t dalg_recursion_tStart;
-
-bool unassign(int level) {  
-   for(int kk=0;kk<Nnodes;kk++) { 
-      if(Node[kk].assign_level>level ) {
-         Node[kk].value=LOGIC_X; 
-         Node[kk].assign_level=-1;
-      } 
-   } 
-   return true;
+// ------------------------------------- FAN -------------------------------------------------------------------
+// FAN shares the PODEM implication (podemImply/podemUndo), D frontier and X-path
+// check, but makes its decisions on headlines instead of PIs, chooses them by
+// multiple backtrace, and adds the unique sensitization objectives of the dominators.
+
+/** @brief Is Gate* g a headline for the current fault?
+ *
+ * A headline whose fanout-free cone holds the fault site is not: the values
+ * inside that cone matter for the fault effect, so the search goes below it.
+ */
+bool fanIsHead(SearchState &S, NSTRUC* g) {
+  return g->headline && S[g].fcone != S.coneStamp;
 }
 
-bool check_Dfront (int node){
-   NSTRUC *np; 
-   np =&Node[node];
-   int Dnum=0; 
-   int Dbarnum=0, Onenum=0, Zeronum=0;
-   for(int j=0;j<(np->fin); j++ ){
-      if(np->unodes[j]->value == LOGIC_D) Dnum++;
-      else if(np->unodes[j]->value == LOGIC_DBAR) Dbarnum++;
-      else if(np->unodes[j]->value == LOGIC_1) Onenum++;
-      else if(np->unodes[j]->value == LOGIC_0) Zeronum++;
-   }
-   if( (Dnum==0 && Dbarnum==0)|| np->value!=LOGIC_X ||(Dnum>0 && Dbarnum>0) || (Onenum>0 && (np->type==GATE_OR || np->type==GATE_NOR || np->type==GATE_NOT || np->type==GATE_BRANCH))
-      || (Zeronum>0 && (np->type==GATE_NAND || np->type==GATE_AND || np->type==GATE_NOT || np->type==GATE_BRANCH )))
-   { return false;}
-   else { return true; }
+
+/** @brief Add n0/n1 requests for values 0/1 on Gate* g to the current multiple backtrace.
+ */
+void mbAdd(SearchState &S, NSTRUC* g, int n0, int n1) {
+  if (S[g].mbstamp != S.mbStamp) {
+    S[g].mbstamp = S.mbStamp;
+    S[g].mb0 = S[g].mb1 = 0;
+    S.mbQueue[g->level].push_back(g);
+  }
+  S[g].mb0 += n0;
+  S[g].mb1 += n1;
 }
-   
-int getDfront(){
-
-   vector<int> tmp; 
-   tmp.clear();
-   Dfront.clear();
-   tmp.push_back((int)(check_fault.first));
-
-      for(int i=0; i<tmp.size(); i++){
-         NSTRUC *np =&Node[tmp[i]];
-         if(np->fout>0){
-            for( int k=0;k<np->fout; k++){
-               if  ( check_Dfront(np->dnodes[k]->indx) ){ 
-                     Dfront.push_back(np->dnodes[k]->indx);
-               }
-               else if ( np->dnodes[k]->value==LOGIC_D || np->dnodes[k]->value==LOGIC_DBAR ){
-                  tmp.push_back(np->dnodes[k]->indx);
-               }
+
+
+/** @brief FAN objectives for the current state.
+ * \param obj Output: the objectives (gate, value) to backtrace together.
+ * \returns false if no test can be reached from the current state.
+ *
+ * Before activation the objectives are the activation value and the unique
+ * sensitization of the dominators of the fault site; afterwards, the X inputs
+ * of the most observable D-frontier gate and the unique sensitization of the
+ * dominators common to the whole D frontier.
+ */
+bool fanObjectives(SearchState &S, vector<pair<NSTRUC *, int> > &obj) {
+  obj.clear();
+  if (S[S.faultLocation].value == LOGIC_X) {
+    if (learnConflict(S, S.faultLocation, S.faultActivationVal)) return false;
+    obj.push_back(make_pair(S.faultLocation, S.faultActivationVal));
+    return sensitizeDominators(S, S.faultLocation->idom, obj);
+  }
+  if (S[S.faultLocation].value == LOGIC_0 || S[S.faultLocation].value == LOGIC_1 || S.dFrontier.empty()) return false;
+
+  NSTRUC* d = dFrontierBest(S);
+  int c = controllingValue(d);
+  for (int i=0; i<d->fin; i++) {
+    if (S[d->unodes[i]].value != LOGIC_X) continue;
+    obj.push_back(make_pair(d->unodes[i], (c == LOGIC_X) ? LOGIC_0 : 1 - c));
+    if (c == LOGIC_X) break;    // XOR: one input is enough to aim at
+  }
+
+  return sensitizeDominators(S, dFrontierDominator(S), obj);
+}
+
+/** @brief FAN multiple backtrace.
+ * \param obj The objectives to satisfy together.
+ * \param head Output: the headline (or PI) to assign.
+ * \param headVal Output: the value to assign to it.
+ * \returns false if no objective could be traced to an unassigned headline.
+ *
+ * The objectives are traced down level by level at once, counting at every
+ * line how many of them ask for 0 and for 1. Counts from all branches meet at
+ * a fanout stem; if they disagree there, the stem with its majority value
+ * becomes the single objective and the backtrace starts again from it.
+ * Otherwise the headline with the most requests is returned with its majority value.
+ */
+bool fanMultipleBacktrace(SearchState &S, vector<pair<NSTRUC *, int> > obj, NSTRUC* &head, int &headVal) {
+  while (true) {
+    S.mbStamp++;
+    for (int i=0; i<obj.size(); i++) mbAdd(S, obj[i].first, obj[i].second == LOGIC_0, obj[i].second == LOGIC_1);
+
+    NSTRUC* stem = NULL;
+    head = NULL;
+    for (int lvl = S.C.maxLevel; lvl >= 0; lvl--) {
+      vector<NSTRUC *> &bucket = S.mbQueue[lvl];
+      for (int i=0; i<bucket.size() && stem == NULL; i++) {
+        NSTRUC* g = bucket[i];
+        if (fanIsHead(S, g) || g->type == GATE_PI) {
+          if (head == NULL || max(S[g].mb0, S[g].mb1) > max(S[head].mb0, S[head].mb1)) head = g;
+          continue;
+        }
+        if (g->fout > 1 && S[g].mb0 > 0 && S[g].mb1 > 0) {
+          stem = g;
+          continue;
+        }
+
+        // requests on the gate output -> requests on its X inputs
+        bool inv = (g->type == GATE_NOT || g->type == GATE_NAND || g->type == GATE_NOR);
+        int o0 = inv ? S[g].mb1 : S[g].mb0, o1 = inv ? S[g].mb0 : S[g].mb1;
+        int c = controllingValue(g);
+        NSTRUC* easiest = NULL;
+        int parity = 0;
+        for (int j=0; j<g->fin; j++) {
+          NSTRUC* in = g->unodes[j];
+          if (S[in].value == LOGIC_0 || S[in].value == LOGIC_1) parity ^= S[in].value;
+          if (S[in].value != LOGIC_X) continue;
+          int cost = (c == LOGIC_0) ? in->cc0 : (c == LOGIC_1) ? in->cc1 : min(in->cc0, in->cc1);
+          if (easiest == NULL || cost < ((c == LOGIC_0) ? easiest->cc0 : (c == LOGIC_1) ? easiest->cc1 : min(easiest->cc0, easiest->cc1)))
+            easiest = in;
+        }
+        if (easiest == NULL) continue;
+
+        if (c == LOGIC_X) {
+          // BRANCH, NOT, XOR: the other X inputs are aimed at 0, the easiest one makes the parity
+          for (int j=0; j<g->fin; j++) {
+            NSTRUC* in = g->unodes[j];
+            if (S[in].value == LOGIC_X && in != easiest) mbAdd(S, in, o0 + o1, 0);
+          }
+          if (parity) mbAdd(S, easiest, o1, o0);
+          else mbAdd(S, easiest, o0, o1);
+        }
+        else {
+          // controlling output value: the easiest input; the other value: all X inputs
+          int oc = (c == LOGIC_0) ? o0 : o1, on = (c == LOGIC_0) ? o1 : o0;
+          if (oc > 0) mbAdd(S, easiest, (c == LOGIC_0) ? oc : 0, (c == LOGIC_1) ? oc : 0);
+          if (on > 0) {
+            for (int j=0; j<g->fin; j++) {
+              NSTRUC* in = g->unodes[j];
+              if (S[in].value == LOGIC_X) mbAdd(S, in, (c == LOGIC_1) ? on : 0, (c == LOGIC_0) ? on : 0);
             }
-         }
+          }
+        }
       }
-      return 0;
-}
+      if (stem != NULL) {
+        for (int l = lvl; l >= 0; l--) S.mbQueue[l].clear();
+        break;
+      }
+      bucket.clear();
+    }
 
+    if (stem == NULL) {
+      if (head == NULL) return false;
+      headVal = (S[head].mb1 > S[head].mb0 || (S[head].mb1 == S[head].mb0 && head->cc1 < head->cc0)) ? LOGIC_1 : LOGIC_0;
+      return true;
+    }
+    obj.assign(1, make_pair(stem, (S[stem].mb1 > S[stem].mb0) ? LOGIC_1 : LOGIC_0));
+  }
+}
 
+/** @brief Justify value v on Gate* g inside its fanout-free cone by assigning PIs.
+ *
+ * The cone is a tree, so each line is reached once and the choices never conflict.
+ */
+void fanJustify(SearchState &S, NSTRUC* g, int v) {
+  if (g->type == GATE_PI) {
+    if (S[g].value == LOGIC_X) podemImply(S, g, v);
+    return;
+  }
+  int c = controllingValue(g);
+  bool inv = (g->type == GATE_NOT || g->type == GATE_NAND || g->type == GATE_NOR);
+  int need = inv ? 1 - v : v;
+
+  if (c == LOGIC_X) {
+    // BRANCH, NOT, XOR: inputs after the first at 0, the first one makes the parity
+    for (int i=1; i<g->fin; i++) fanJustify(S, g->unodes[i], LOGIC_0);
+    fanJustify(S, g->unodes[0], need);
+  }
+  else if (need == c) {
+    NSTRUC* easiest = g->unodes[0];
+    for (int i=1; i<g->fin; i++) {
+      if ((c == LOGIC_0 ? g->unodes[i]->cc0 : g->unodes[i]->cc1) < (c == LOGIC_0 ? easiest->cc0 : easiest->cc1)) easiest = g->unodes[i];
+    }
+    fanJustify(S, easiest, c);
+  }
+  else {
+    for (int i=0; i<g->fin; i++) fanJustify(S, g->unodes[i], 1 - c);
+  }
+}
 
-bool imply_and_check(){
-	
-	for(int kk=0; kk< imply.size(); kk++){
-	   NSTRUC *np =&Node[imply[kk]];
-	   if(np->value != LOGIC_D && np->value != LOGIC_DBAR) {
-	   //backward imply
-		   if(np->type == GATE_PI) return true;
-
-         else if( np->type == GATE_BRANCH) {		
-            for(int jj=0;jj<(np->fin);jj++){
-               if(np->value==LOGIC_0) { 
-                  if(np->unodes[jj]->value==LOGIC_X) { 
-                     np->unodes[jj]->value = LOGIC_0;   
-                     imply.push_back(np->unodes[jj]->indx);
-                  } else if (np->unodes[jj]->value!=LOGIC_0 ) {
-                     return false;
-                  }
-               }
-               if(np->value==LOGIC_1) { 
-                  if(np->unodes[jj]->value==LOGIC_X) { 
-                     np->unodes[jj]->value = LOGIC_1;   
-                     imply.push_back(np->unodes[jj]->indx);
-                  } else if (np->unodes[jj]->value!=LOGIC_1 ) {
-                     return false;
-                  }
-               }
-            } 
-         
-         }// branch
-         // forward propagation
-
-         else if (np->type == GATE_XOR) { 
-            int num_inputX=0; 
-            int oneXind=0; 
-            int implyvalue=np->value; 
-            for(int jj=0;jj<(np->fin);jj++) { 
-               if(np->unodes[jj]->value==LOGIC_1 || np->unodes[jj]->value==LOGIC_0) {
-                  implyvalue^=np->unodes[jj]->value;
-               } else if (np->unodes[jj]->value==LOGIC_D || np->unodes[jj]->value==LOGIC_DBAR) {
-                  return false;
-               } else {
-                  oneXind=jj;
-                  num_inputX++; 
-               }
-            }
-            if(num_inputX==1) { 
-               np->unodes[oneXind]->value =  implyvalue;   
-               imply.push_back(np->unodes[oneXind]->indx);   
-            } else {
-               Jfront.push_back(np->indx);
-            } 
-         } //xor
-         // j frontier : 1. at least two inputs are unknown  2. no control value of input(so that output can be implied)
-				
-         else if  ( np->type == GATE_OR) {
-            if(np->value==LOGIC_0)  { 
-               for(int jj=0;jj<(np->fin);jj++){
-                  if(np->unodes[jj]->value!=LOGIC_0 && np->unodes[jj]->value!=LOGIC_X) {
-                     return false;
-                  }
-                  else if(np->unodes[jj]->value==LOGIC_X){ 
-                     np->unodes[jj]->value = 0;   
-                     imply.push_back(np->unodes[jj]->indx);   
-                  }
-               }   
-            }
-            if(np->value==LOGIC_1){ 
-               bool has_controlvalue=false; 
-               int unknown_num=0;
-               int oneXind=0; 
-               int Dnum=0; 
-               int Dbarnum=0;
-               for(int jj=0;jj<(np->fin);jj++) {
-                     if(np->unodes[jj]->value==LOGIC_1) { 
-                        has_controlvalue=true; 
-                        break;
-                     } else if (np->unodes[jj]->value==LOGIC_X) {
-                        unknown_num++;  
-                        oneXind=jj;
-                     } else if (np->unodes[jj]->value==LOGIC_D) { 
-                        Dnum++; 
-                     } else if (np->unodes[jj]->value==LOGIC_DBAR) { 
-                        Dbarnum++; 
-                     }
-               }
-               if(has_controlvalue==false && unknown_num==0) {
-                  if(Dnum==0 || Dbarnum==0) { 
-                     return false;
-                  }
-               }
-               else if(has_controlvalue==false && unknown_num ==1) {     
-                  if(!(Dnum>0 && Dbarnum>0)) {
-                     np->unodes[oneXind]->value =  LOGIC_1;   
-                     imply.push_back(np->unodes[oneXind]->indx); 
-                  }
-               }              
-               else if(has_controlvalue==false && unknown_num>1 && !((Dnum>0 && Dbarnum>0))) { 
-                  Jfront.push_back(np->indx);
-               }
-            }
-         }// or
-				
-         else if  ( np->type == GATE_NOR) {
-            if(np->value==LOGIC_1)  { 
-               for(int jj=0;jj<(np->fin);jj++){
-                  if(np->unodes[jj]->value!=LOGIC_0 && np->unodes[jj]->value!=LOGIC_X) {
-                     return false;
-                  } else if (np->unodes[jj]->value==LOGIC_X) {
-                     np->unodes[jj]->value = LOGIC_0;   
-                     imply.push_back(np->unodes[jj]->indx);
-                  }
-               }   
-            }
-            if(np->value==LOGIC_0) {
-               bool has_controlvalue=false; 
-               int unknown_num=0;
-               int oneXind=0; 
-               int Dnum=0; 
-               int Dbarnum=0;
-               for(int jj=0;jj<(np->fin);jj++) {
-                  if(np->unodes[jj]->value==LOGIC_1) { 
-                     has_controlvalue=true; 
-                     break;
-                  } else if (np->unodes[jj]->value==LOGIC_X) {
-                     unknown_num++;  
-                     oneXind=jj;
-                  } else if (np->unodes[jj]->value==LOGIC_D) {
-                     Dnum++;
-                  } else if (np->unodes[jj]->value==LOGIC_DBAR) {
-                     Dbarnum++; 
-                  }
-               }
-               if(has_controlvalue==false && unknown_num==0) {
-                  if(Dnum==0 || Dbarnum==0) {
-                     return false;
-                  }
-               } else if (has_controlvalue==false && unknown_num ==1) {     
-                  if(!(Dnum>0 && Dbarnum>0)) {
-                     np->unodes[oneXind]->value = LOGIC_1;   
-                     imply.push_back(np->unodes[oneXind]->indx); 
-                  }
-               } else if (has_controlvalue==false && unknown_num>1 && !((Dnum>0 && Dbarnum>0))) {
-                  Jfront.push_back(np->indx);
-               }
-            }
-         } // nor
-
-         else if  ( np->type == GATE_NOT) {
-            if(np->value==LOGIC_0) {
-               if(np->unodes[0]->value==LOGIC_X) { 
-                  np->unodes[0]->value = LOGIC_1;   
-                  imply.push_back(np->unodes[0]->indx);
-               } else if(np->unodes[0]->value!=LOGIC_1) {
-                  return false;
-               }
-            }
-            if (np->value==LOGIC_1) {
-               if (np->unodes[0]->value==LOGIC_X) {
-                  np->unodes[0]->value = LOGIC_0;
-                  imply.push_back(np->unodes[0]->indx);
-               } else if (np->unodes[0]->value!=LOGIC_0) {
-                  return false;
-               }
-            }
-         } //not
-
-         else if  ( np->type == GATE_NAND) {
-            if(np->value==LOGIC_0)  { 
-               for(int jj=0;jj<(np->fin);jj++){
-                  if(np->unodes[jj]->value!=LOGIC_1 && np->unodes[jj]->value!=LOGIC_X) {
-                     return false;
-                  } else if (np->unodes[jj]->value==LOGIC_X) {
-                     np->unodes[jj]->value = LOGIC_1;
-                     imply.push_back(np->unodes[jj]->indx);
-                  }
-               }   
-            }
-            if (np->value==LOGIC_1) {
-               bool has_controlvalue=false; 
-               int unknown_num=0;
-               int oneXind=0; 
-               int Dnum=0; 
-               int Dbarnum=0;
-               for(int jj=0;jj<(np->fin);jj++) {
-                  if(np->unodes[jj]->value==LOGIC_0) { 
-                     has_controlvalue=true; 
-                     break;
-                  } else if (np->unodes[jj]->value==LOGIC_X) {
-                     unknown_num++;  
-                     oneXind=jj;
-                  } else if (np->unodes[jj]->value==LOGIC_D) {
-                     Dnum++; 
-                  } else if (np->unodes[jj]->value==LOGIC_DBAR) {
-                     Dbarnum++; 
-                  }
-               }
-               if (has_controlvalue==false && unknown_num==0) {
-                  if(Dnum==0 || Dbarnum==0) {
-                     return false;
-                  }
-               } else if (has_controlvalue==false && unknown_num ==1) {     
-                  if(!(Dnum>0 && Dbarnum>0)) {
-                     np->unodes[oneXind]->value =  LOGIC_0;   
-                     imply.push_back(np->unodes[oneXind]->indx); 
-                  }
-               } else if (has_controlvalue==false && unknown_num>1 && !((Dnum>0 && Dbarnum>0))) {
-                  Jfront.push_back(np->indx);
-               }
-            }
-         }// Nand
-         
-         else if  ( np->type == GATE_AND) {
-            if(np->value==LOGIC_1)  { 
-               for(int jj=0;jj<(np->fin);jj++){
-                  if(np->unodes[jj]->value!=LOGIC_1 && np->unodes[jj]->value!=LOGIC_X) {
-                     return false;
-                  } else if (np->unodes[jj]->value==LOGIC_X) {
-                     np->unodes[jj]->value = LOGIC_1;   
-                     imply.push_back(np->unodes[jj]->indx);
-                  }
-               }   
-            }
-            if(np->value==LOGIC_0) { 
-               bool has_controlvalue=false; 
-               int unknown_num=0;
-               int oneXind=0; 
-               int Dnum=0; 
-               int Dbarnum=0;
-               for(int jj=0;jj<(np->fin);jj++) {
-                  if(np->unodes[jj]->value==LOGIC_0) { 
-                     has_controlvalue=true; 
-                     break;
-                  } else if (np->unodes[jj]->value==LOGIC_X) {
-                     unknown_num++;  
-                     oneXind=jj;
-                  } else if (np->unodes[jj]->value==LOGIC_D) {
-                     Dnum++; 
-                  } else if (np->unodes[jj]->value==LOGIC_DBAR) {
-                     Dbarnum++; 
-                  }
-               }
-               if(has_controlvalue==false && unknown_num==0) {
-                  if(Dnum==0 || Dbarnum==0) { 
-                     return false;
-                  }
-               } else if(has_controlvalue==false && unknown_num ==1) {     
-                  if(!(Dnum>0 && Dbarnum>0)) {
-                  //else
-                  np->unodes[oneXind]->value = LOGIC_0;   
-                  imply.push_back(np->unodes[oneXind]->indx); }
-               } else if(has_controlvalue==false && unknown_num>1 && !((Dnum>0 && Dbarnum>0))) { 
-                  Jfront.push_back(np->indx);
-               }
-            }
-         } // and
-		}
+/** @brief FAN search.
+ *
+ * Same decision stack and budget as podemSearch, with FAN objectives and
+ * multiple backtrace. Once a fault effect reaches an output, the assigned
+ * headlines are justified through their fanout-free cones.
+ * \returns ATPG_DETECTED, ATPG_UNTESTABLE or ATPG_ABORTED.
+ */
+int fanSearch(SearchState &S) {
+
+  vector<podemDecision> decisions;
+  vector<pair<NSTRUC *, int> > obj;
+  int backtracks = 0;
 
+  while (true) {
+   if (atpgBudgetExceeded(S, backtracks, S.podem_tStart)) {
+      podemUndo(S, 0);
+      return ATPG_ABORTED;
+   }
 
-	   //forward imply								 
-      for(int jj=0;jj<(np->fout);jj++){
-         NSTRUC *np_out;		
-         np_out = &Node[np->dnodes[jj]->indx];	
-         if(np->dnodes[jj]->num == (check_fault.first) ) continue;
-         int Xnum=0;  
-         int Dnum=0;
-         int Dbarnum=0;
-         int Onenum=0;
-         int Zeronum=0;
-         int expect_outvalue= 0;
-         for(int jj=0;jj<(np_out->fin);jj++) {
-               if      (np_out->unodes[jj]->value==LOGIC_X) Xnum++;
-               else if (np_out->unodes[jj]->value==LOGIC_D) Dnum++;
-               else if (np_out->unodes[jj]->value==LOGIC_DBAR) Dbarnum++;
-               else if (np_out->unodes[jj]->value==LOGIC_1) Onenum++; 
-               else if (np_out->unodes[jj]->value==LOGIC_0) Zeronum++;
+   for (int i = 0; i < S.C.npo; i++) {
+      int val = S[S.C.po[i]].value;
+      if (val == LOGIC_D || val == LOGIC_DBAR) {
+         for (int j = 0; j < decisions.size(); j++) {
+            if (decisions[j].pi->type != GATE_PI) fanJustify(S, decisions[j].pi, decisions[j].val);
          }
+         return ATPG_DETECTED;
+      }
+   }
 
-         //branch
-         if(np_out->type==GATE_BRANCH){
-            if(np->value==LOGIC_0) { 
-               if(np_out->value==LOGIC_X) {
-                  np_out->value = LOGIC_0;
-                  imply.push_back(np_out->indx);
-               } else if (np_out->num!=(int)(check_fault.first) && !(np_out->value==LOGIC_0) && ! (np_out->value==LOGIC_DBAR)) {
-                  return false;
-               }
-            }
-            if(np->value==LOGIC_1) {
-               if(np_out->value==LOGIC_X) {
-                  np_out->value = LOGIC_1;
-                  imply.push_back(np_out->indx);
-               } else if (np_out->num!=(int)(check_fault.first) &&!(np_out->value==LOGIC_1) && ! (np_out->value==LOGIC_D)) {
-                  return false;
-               }
-            }
-            if(np->value==LOGIC_D || np->value==LOGIC_DBAR ) {
-               if(np_out->value==LOGIC_X) {
-                  np_out->value = np->value;   
-                  imply.push_back(np_out->indx);
-               }
+   NSTRUC* head;
+   int headVal;
+   if (xPathCheck(S) && fanObjectives(S, obj) && fanMultipleBacktrace(S, obj, head, headVal)) {
+      podemDecision d = {head, headVal, false, S.podemTrail.size()};
+      decisions.push_back(d);
+      podemImply(S, head, headVal);
+      continue;
+   }
+
+   while (!decisions.empty() && decisions.back().flipped) {
+      podemUndo(S, decisions.back().mark);
+      decisions.pop_back();
+   }
+   if (decisions.empty()) {
+      return ATPG_UNTESTABLE;
+   }
+
+   podemDecision &d = decisions.back();
+   podemUndo(S, d.mark);
+   d.flipped = true;
+   d.val = LogicNot(d.val);
+   podemImply(S, d.pi, d.val);
+   backtracks++;
+  }
+}
+
+/** @brief FAN for fault (an id).
+ * \returns ATPG_DETECTED with the test in the PI values of S, ATPG_UNTESTABLE
+ * or ATPG_ABORTED. Writes no files.
+ */
+int fanGenerate(const Circuit &C, SearchState &S, int fault) {
+   podemReset(S, &C.node[FAULT_NODE(fault)], FAULT_STUCK(fault));
+   S.mbQueue.assign(C.maxLevel + 1, vector<NSTRUC *>());
+   return fanSearch(S);
+}
+
+/** @brief FAN command: generate a test for one stuck-at fault.
+ *
+ * Arguments and output file (<circuit>_FAN_<node>@<value>.txt) are the same
+ * as for PODEM. \returns ATPG_DETECTED, ATPG_UNTESTABLE or ATPG_ABORTED.
+ */
+int fan(char *cp) {
+   char faultNode_buf[MAXLINE], faultValue_buf[MAXLINE];
+   sscanf(cp, "%s %s", faultNode_buf, faultValue_buf);
+
+   int fault = faultArg(faultNode_buf, faultValue_buf);
+   if (fault < 0) {
+      cout << "invalid argument" << endl;
+      return 1;
+   }
+   SearchState S(circuit);
+   int res = fanGenerate(circuit, S, fault);
+   if (res == ATPG_DETECTED) {
+      writeTestCube(circuitName + "_FAN_" + faultNode_buf + "@" + faultValue_buf + ".txt", atpgTestCube(S));
+   }
+   return res;
+}
+
+
+// ------------------------------------- SAT -------------------------------------------------------------------
+// SAT-based ATPG: the fault is encoded as a good/faulty miter in CNF (Tseitin)
+// and solved by a small self-contained CDCL solver. Unlike the search engines
+// it either finds a test or proves the fault untestable, up to settings.satConflicts.
+
+// A literal is 2*var + sign (sign 1 = negated).
+#define SAT_NEG(lit) ((lit) ^ 1)
+#define SAT_UNDEF -1
+
+struct satSolver {
+   int nvars;
+   bool unsat;                           // an empty clause was derived at level 0
+   vector<vector<int> > clauses;         // literals 0 and 1 of a clause are watched
+   vector<vector<int> > watches;         // per literal: clauses watching it
+   vector<signed char> assign;           // per var: SAT_UNDEF, 0 or 1
+   vector<int> level, reason;            // per var: decision level and implying clause (-1 = decision)
+   vector<int> trail, trailLim;
+   int qhead;
+   vector<double> activity;              // VSIDS
+   double varInc;
+   vector<signed char> phase;            // saved phase per var
+   vector<int> heap, heapPos;            // max-heap of vars by activity
+   vector<char> seen;
+};
+
+void satInit(satSolver &s) {
+   s.nvars = 0;
+   s.unsat = false;
+   s.qhead = 0;
+   s.varInc = 1.0;
+}
+
+inline int satValue(const satSolver &s, int lit) {
+   int a = s.assign[lit >> 1];
+   return (a == SAT_UNDEF) ? SAT_UNDEF : (a ^ (lit & 1));
+}
+
+void satHeapUp(satSolver &s, int i) {
+   int v = s.heap[i];
+   while (i > 0 && s.activity[s.heap[(i - 1) / 2]] < s.activity[v]) {
+      s.heap[i] = s.heap[(i - 1) / 2];
+      s.heapPos[s.heap[i]] = i;
+      i = (i - 1) / 2;
+   }
+   s.heap[i] = v;
+   s.heapPos[v] = i;
+}
+
+void satHeapDown(satSolver &s, int i) {
+   int v = s.heap[i];
+   while (2 * i + 1 < s.heap.size()) {
+      int c = 2 * i + 1;
+      if (c + 1 < s.heap.size() && s.activity[s.heap[c + 1]] > s.activity[s.heap[c]]) c++;
+      if (s.activity[s.heap[c]] <= s.activity[v]) break;
+      s.heap[i] = s.heap[c];
+      s.heapPos[s.heap[i]] = i;
+      i = c;
+   }
+   s.heap[i] = v;
+   s.heapPos[v] = i;
+}
+
+void satHeapInsert(satSolver &s, int v) {
+   if (s.heapPos[v] >= 0) return;
+   s.heap.push_back(v);
+   satHeapUp(s, s.heap.size() - 1);
+}
+
+int satHeapPop(satSolver &s) {
+   int v = s.heap[0];
+   s.heap[0] = s.heap.back();
+   s.heap.pop_back();
+   s.heapPos[v] = -1;
+   if (!s.heap.empty()) {
+      s.heapPos[s.heap[0]] = 0;
+      satHeapDown(s, 0);
+   }
+   return v;
+}
+
+int satNewVar(satSolver &s) {
+   int v = s.nvars++;
+   s.watches.resize(2 * s.nvars);
+   s.assign.push_back(SAT_UNDEF);
+   s.level.push_back(0);
+   s.reason.push_back(-1);
+   s.activity.push_back(0.0);
+   s.phase.push_back(0);
+   s.seen.push_back(0);
+   s.heapPos.push_back(-1);
+   satHeapInsert(s, v);
+   return v;
+}
+
+void satEnqueue(satSolver &s, int lit, int from) {
+   int v = lit >> 1;
+   s.assign[v] = !(lit & 1);
+   s.level[v] = s.trailLim.size();
+   s.reason[v] = from;
+   s.trail.push_back(lit);
+}
+
+/** @brief Add a clause before solving (level 0); duplicate and false literals are dropped.
+ */
+void satAddClause(satSolver &s, vector<int> lits) {
+   if (s.unsat) return;
+   sort(lits.begin(), lits.end());
+   vector<int> c;
+   for (int i = 0; i < lits.size(); i++) {
+      int val = satValue(s, lits[i]);
+      if (val == 1 || (i > 0 && lits[i] == SAT_NEG(lits[i - 1]))) return;   // satisfied or tautology
+      if (val == 0 || (i > 0 && lits[i] == lits[i - 1])) continue;
+      c.push_back(lits[i]);
+   }
+   if (c.empty()) {
+      s.unsat = true;
+   }
+   else if (c.size() == 1) {
+      satEnqueue(s, c[0], -1);
+   }
+   else {
+      s.clauses.push_back(c);
+      s.watches[c[0]].push_back(s.clauses.size() - 1);
+      s.watches[c[1]].push_back(s.clauses.size() - 1);
+   }
+}
+
+/** @brief Unit propagation with two watched literals. \returns the conflicting clause or -1.
+ */
+int satPropagate(satSolver &s) {
+   while (s.qhead < s.trail.size()) {
+      int falseLit = SAT_NEG(s.trail[s.qhead++]);
+      vector<int> &ws = s.watches[falseLit];
+      int i, j;
+      for (i = j = 0; i < ws.size(); i++) {
+         int ci = ws[i];
+         vector<int> &c = s.clauses[ci];
+         if (c[0] == falseLit) swap(c[0], c[1]);
+         if (satValue(s, c[0]) == 1) {
+            ws[j++] = ci;
+            continue;
+         }
+         // look for a new literal to watch
+         bool moved = false;
+         for (int k = 2; k < c.size(); k++) {
+            if (satValue(s, c[k]) != 0) {
+               swap(c[1], c[k]);
+               s.watches[c[1]].push_back(ci);
+               moved = true;
+               break;
             }
          }
+         if (moved) continue;
+         ws[j++] = ci;
+         if (satValue(s, c[0]) == 0) {
+            for (i++; i < ws.size(); i++) ws[j++] = ws[i];
+            ws.resize(j);
+            return ci;
+         }
+         satEnqueue(s, c[0], ci);
+      }
+      ws.resize(j);
+   }
+   return -1;
+}
 
-         else if(np_out->type==GATE_NOT){
-            if(np->value==LOGIC_0) {
-               if(np_out->value==LOGIC_X) {
-                  np_out->value = LOGIC_1;   
-                  imply.push_back(np_out->indx);
-               } else if (np_out->num!=(int)(check_fault.first) && !(np_out->value==LOGIC_1)  && ! (np_out->value==LOGIC_D) ) {
-                  return false;
-               }
-            }
-            if(np->value==LOGIC_1) { 
-               if(np_out->value==LOGIC_X) { 
-                  np_out->value = LOGIC_0;   
-                  imply.push_back(np_out->indx);
-               } else if (np_out->num!=(int)(check_fault.first) && !(np_out->value==LOGIC_0) && ! (np_out->value==LOGIC_DBAR)) {
-                  return false;
-               }
-            } 
-            if(np->value==LOGIC_D) { 
-               if(np_out->value==LOGIC_X) { 
-                  np_out->value = LOGIC_DBAR;   
-                  imply.push_back(np_out->indx);
-               }       
-            }
-            if(np->value==LOGIC_DBAR) { 
-               if(np_out->value==LOGIC_X) {
-                  np_out->value = LOGIC_D;   
-                  imply.push_back(np_out->indx);
-               }
-            }
-         }//not
-
-         else if(np_out->type==GATE_XOR){
-         //try to imply
-            if(np_out->value ==LOGIC_X && Xnum==0 ) { 
-               if(Dnum%2==0 && Dbarnum%2==0) {
-                  if(Onenum%2==1) {
-                     np_out->value=LOGIC_1;
-                  } else {
-                     np_out->value=LOGIC_0;
-                  } 
-                  imply.push_back(np_out->indx);
-               } else if (Dnum==Dbarnum && Onenum%2==1) {
-                  np_out->value=LOGIC_0; 
-                  imply.push_back(np_out->indx);
-               } else if(Dnum==Dbarnum && Onenum%2==0) {
-                  np_out->value=LOGIC_1; 
-                  imply.push_back(np_out->indx);
-               }
-            }
-            
-            // check
-            else if(np_out->value==LOGIC_1 && Xnum==0) { 
-               if(Dnum%2==0 && Dbarnum%2==0) {
-                  if(Onenum%2==1) {
-                     if(np_out->value==LOGIC_0) {
-                        return false;
-                     }
-                  }
-               } else if(Dnum==Dbarnum && Onenum%2==0) { 
-                  if(np_out->value==LOGIC_0) {
-                     return false;
-                  }
-               }
-            } else if(np_out->value==LOGIC_0 && Xnum==0) { 
-               if(Dnum%2==0 && Dbarnum%2==0) {
-                  if(Onenum%2==0) {
-                     if(np_out->value==LOGIC_1) {
-                        return false;
-                     }
-                  }
-               } else if(Dnum==Dbarnum && Onenum%2==1) {
-                  if(np_out->value==LOGIC_1) {
-                     return false;
-                  }
-               }
-            }
-         }//xor
-            
-         else if(np_out->type==GATE_OR){
-            //try to imply
-            if(np_out->value ==LOGIC_X ) { 
-               if(Onenum>0 ||  (Dnum>0&& Dbarnum>0)) {
-                  np_out->value=LOGIC_1; 
-                  imply.push_back(np_out->indx);
-               } else if (Xnum==0 && Zeronum==np_out->fin) {
-                  np_out->value=LOGIC_0; 
-                  imply.push_back(np_out->indx);
-               } else if( (Zeronum+Dnum) == np_out->fin) {
-                  np_out->value=LOGIC_D; 
-                  imply.push_back(np_out->indx);
-               } else if( (Zeronum+Dbarnum) == np_out->fin) {
-                  np_out->value=LOGIC_DBAR; 
-                  imply.push_back(np_out->indx);
-               }
-            }
-            // check
-            else if(np_out->value==LOGIC_1) {
-               if(!(Onenum>0 ||  (Dnum>0&& Dbarnum>0))) {
-                  return false;
-               }
-            } else if (np_out->value==LOGIC_0) {
-               if(!(Xnum==0 && Zeronum==np_out->fin)) {
-                  return false;
-               }
+void satBumpVar(satSolver &s, int v) {
+   s.activity[v] += s.varInc;
+   if (s.activity[v] > 1e100) {
+      for (int i = 0; i < s.nvars; i++) s.activity[i] *= 1e-100;
+      s.varInc *= 1e-100;
+   }
+   if (s.heapPos[v] >= 0) satHeapUp(s, s.heapPos[v]);
+}
+
+/** @brief First-UIP conflict analysis.
+ * \param learnt Output: the learnt clause, asserting literal first.
+ * \returns the level to backjump to.
+ */
+int satAnalyze(satSolver &s, int confl, vector<int> &learnt) {
+   int pathCount = 0, p = -1, index = s.trail.size() - 1;
+   int curLevel = s.trailLim.size();
+   learnt.assign(1, -1);
+
+   do {
+      vector<int> &c = s.clauses[confl];
+      for (int k = (p == -1) ? 0 : 1; k < c.size(); k++) {
+         int v = c[k] >> 1;
+         if (s.seen[v] || s.level[v] == 0) continue;
+         s.seen[v] = 1;
+         satBumpVar(s, v);
+         if (s.level[v] == curLevel) pathCount++;
+         else learnt.push_back(c[k]);
+      }
+      while (!s.seen[s.trail[index] >> 1]) index--;
+      p = s.trail[index--];
+      confl = s.reason[p >> 1];
+      s.seen[p >> 1] = 0;
+      pathCount--;
+      // the reason clause of p has p first
+      if (pathCount > 0 && s.clauses[confl][0] != p) {
+         vector<int> &r = s.clauses[confl];
+         for (int k = 1; k < r.size(); k++) {
+            if (r[k] == p) {
+               swap(r[0], r[k]);
+               break;
             }
-         }//or
-      
-         else if(np_out->type==GATE_NOR) {
-            //try to imply
-            if(np_out->value ==LOGIC_X ) { 
-               if(Onenum>0 ||  (Dnum>0&& Dbarnum>0)) {
-                  np_out->value=LOGIC_0; 
-                  imply.push_back(np_out->indx);
-               } else if (Xnum==0 && Zeronum==np_out->fin) {
-                  np_out->value=LOGIC_1; 
-                  imply.push_back(np_out->indx);
-               } else if ((Zeronum+Dnum) == np_out->fin) {
-                  np_out->value=LOGIC_DBAR; 
-                  imply.push_back(np_out->indx);
-               } else if ((Zeronum+Dbarnum) == np_out->fin) {
-                  np_out->value=LOGIC_D; 
-                  imply.push_back(np_out->indx);
-               }
+         }
+      }
+   } while (pathCount > 0);
+   learnt[0] = SAT_NEG(p);
+
+   int back = 0, maxi = 1;
+   for (int k = 1; k < learnt.size(); k++) {
+      s.seen[learnt[k] >> 1] = 0;
+      if (s.level[learnt[k] >> 1] > back) {
+         back = s.level[learnt[k] >> 1];
+         maxi = k;
+      }
+   }
+   if (learnt.size() > 1) swap(learnt[1], learnt[maxi]);
+   s.varInc *= 1.0 / 0.95;
+   return back;
+}
+
+void satBacktrack(satSolver &s, int lvl) {
+   if (s.trailLim.size() <= lvl) return;
+   for (int i = s.trail.size() - 1; i >= s.trailLim[lvl]; i--) {
+      int v = s.trail[i] >> 1;
+      s.phase[v] = s.assign[v];
+      s.assign[v] = SAT_UNDEF;
+      s.reason[v] = -1;
+      satHeapInsert(s, v);
+   }
+   s.trail.resize(s.trailLim[lvl]);
+   s.trailLim.resize(lvl);
+   s.qhead = s.trail.size();
+}
+
+// i-th element (from 0) of the Luby restart sequence 1 1 2 1 1 2 4 ...
+int satLuby(int i) {
+   int size = 1, seq = 0;
+   while (size < i + 1) {
+      seq++;
+      size = 2 * size + 1;
+   }
+   while (size - 1 != i) {
+      size = (size - 1) >> 1;
+      seq--;
+      i = i % size;
+   }
+   return 1 << seq;
+}
+
+/** @brief CDCL search with Luby restarts.
+ * \returns 1 (satisfiable, model in assign), 0 (unsatisfiable) or SAT_UNDEF
+ * when settings.satConflicts or the time budget ran out.
+ */
+int satSolve(SearchState &S, satSolver &s, std::chrono::steady_clock::time_point tStart) {
+   if (s.unsat || satPropagate(s) >= 0) return 0;
+
+   vector<int> learnt;
+   int conflicts = 0, restarts = 0;
+   int restartAt = 100 * satLuby(0);
+   while (true) {
+      int confl = satPropagate(s);
+      if (confl >= 0) {
+         conflicts++;
+         if (s.trailLim.empty()) return 0;
+         int back = satAnalyze(s, confl, learnt);
+         satBacktrack(s, back);
+         if (learnt.size() == 1) {
+            satEnqueue(s, learnt[0], -1);
+         }
+         else {
+            s.clauses.push_back(learnt);
+            int ci = s.clauses.size() - 1;
+            s.watches[learnt[0]].push_back(ci);
+            s.watches[learnt[1]].push_back(ci);
+            satEnqueue(s, learnt[0], ci);
+         }
+         if (conflicts > S.settings.satConflicts) return SAT_UNDEF;
+         if ((conflicts & 255) == 0 && atpgBudgetExceeded(S, 0, tStart)) return SAT_UNDEF;
+         if (conflicts >= restartAt) {
+            restartAt = conflicts + 100 * satLuby(++restarts);
+            satBacktrack(s, 0);
+         }
+      }
+      else {
+         int v = -1;
+         while (!s.heap.empty()) {
+            v = satHeapPop(s);
+            if (s.assign[v] == SAT_UNDEF) break;
+            v = -1;
+         }
+         if (v < 0) return 1;
+         s.trailLim.push_back(s.trail.size());
+         satEnqueue(s, 2 * v + (s.phase[v] ? 0 : 1), -1);
+      }
+   }
+}
+
+/** @brief Tseitin clauses for y = gate(type)(x).
+ */
+void satGate(satSolver &s, int type, int y, const vector<int> &x) {
+   int Y = 2 * y;
+   switch (type) {
+   case GATE_BRANCH:
+   case GATE_NOT: {
+      int X = 2 * x[0] + (type == GATE_NOT);
+      satAddClause(s, {SAT_NEG(Y), X});
+      satAddClause(s, {Y, SAT_NEG(X)});
+      break;
+   }
+   case GATE_AND:
+   case GATE_NAND:
+   case GATE_OR:
+   case GATE_NOR: {
+      // AND form: out = x1 & x2 & ...; OR is AND of the complements, complemented
+      bool orType = (type == GATE_OR || type == GATE_NOR);
+      bool inv = (type == GATE_NAND || type == GATE_OR);
+      int out = inv ? SAT_NEG(Y) : Y;
+      vector<int> big(1, out);
+      for (int i = 0; i < x.size(); i++) {
+         int X = 2 * x[i] + orType;
+         satAddClause(s, {SAT_NEG(out), X});
+         big.push_back(SAT_NEG(X));
+      }
+      satAddClause(s, big);
+      break;
+   }
+   case GATE_XOR: {
+      int acc = 2 * x[0];
+      for (int i = 1; i < x.size(); i++) {
+         int b = 2 * x[i];
+         int t = (i == x.size() - 1) ? Y : 2 * satNewVar(s);
+         satAddClause(s, {SAT_NEG(t), acc, b});
+         satAddClause(s, {SAT_NEG(t), SAT_NEG(acc), SAT_NEG(b)});
+         satAddClause(s, {t, SAT_NEG(acc), b});
+         satAddClause(s, {t, acc, SAT_NEG(b)});
+         acc = t;
+      }
+      if (x.size() == 1) {
+         satAddClause(s, {SAT_NEG(Y), acc});
+         satAddClause(s, {Y, SAT_NEG(acc)});
+      }
+      break;
+   }
+   default: break;
+   }
+}
+
+/** @brief SAT ATPG for stuck-at fault (site, stuck).
+ * \returns ATPG_DETECTED with the test in the PI values (X where the PI is
+ * outside the encoded cones), ATPG_UNTESTABLE if the miter is unsatisfiable,
+ * or ATPG_ABORTED if the solver ran out of budget.
+ *
+ * Good-machine variables cover the fanin cone of every primary output the
+ * fault can reach; faulty-machine variables exist only in the fault's fanout
+ * cone (the site itself is the stuck constant), and at least one of those
+ * outputs must differ between the two. Lines without fanout that are not
+ * primary outputs are not observed, as in fault simulation.
+ */
+int satAtpg(SearchState &S, NSTRUC* site, int stuck) {
+   std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+   markFaultCone(S, site);
+
+   vector<NSTRUC *> outs;
+   for (int i = 0; i < S.C.nnodes; i++) {
+      if (S.node[i].fcone == S.coneStamp && S.C.node[i].po) outs.push_back(&S.C.node[i]);
+   }
+   for (int i = 0; i < S.C.nnodes; i++) S.node[i].value = LOGIC_X;
+   if (outs.empty()) return ATPG_UNTESTABLE;
+
+   satSolver s;
+   satInit(s);
+   vector<int> goodVar(S.C.nnodes, -1), faultyVar(S.C.nnodes, -1);
+
+   // good machine: fanin cone of the reachable outputs
+   vector<NSTRUC *> stack(outs), cone;
+   for (int i = 0; i < outs.size(); i++) goodVar[outs[i]->indx] = satNewVar(s);
+   while (!stack.empty()) {
+      NSTRUC* g = stack.back();
+      stack.pop_back();
+      cone.push_back(g);
+      for (int j = 0; j < g->fin; j++) {
+         if (goodVar[g->unodes[j]->indx] < 0) {
+            goodVar[g->unodes[j]->indx] = satNewVar(s);
+            stack.push_back(g->unodes[j]);
+         }
+      }
+   }
+   vector<int> x;
+   for (int i = 0; i < cone.size(); i++) {
+      NSTRUC* g = cone[i];
+      if (g->fin == 0) continue;
+      x.clear();
+      for (int j = 0; j < g->fin; j++) x.push_back(goodVar[g->unodes[j]->indx]);
+      satGate(s, g->type, goodVar[g->indx], x);
+   }
+
+   // faulty machine: the fanout cone of the site
+   for (int i = 0; i < cone.size(); i++) {
+      if (S[cone[i]].fcone == S.coneStamp) faultyVar[cone[i]->indx] = satNewVar(s);
+   }
+   for (int i = 0; i < cone.size(); i++) {
+      NSTRUC* g = cone[i];
+      if (faultyVar[g->indx] < 0 || g == site) continue;
+      x.clear();
+      for (int j = 0; j < g->fin; j++) {
+         int in = g->unodes[j]->indx;
+         x.push_back((faultyVar[in] >= 0) ? faultyVar[in] : goodVar[in]);
+      }
+      satGate(s, g->type, faultyVar[g->indx], x);
+   }
+   satAddClause(s, {2 * faultyVar[site->indx] + (stuck == 0)});
+   satAddClause(s, {2 * goodVar[site->indx] + (stuck == 1)});
+
+   // miter: some reachable output differs
+   vector<int> differ;
+   for (int i = 0; i < outs.size(); i++) {
+      int G = 2 * goodVar[outs[i]->indx], F = 2 * faultyVar[outs[i]->indx];
+      int d = 2 * satNewVar(s);
+      satAddClause(s, {SAT_NEG(d), G, F});
+      satAddClause(s, {SAT_NEG(d), SAT_NEG(G), SAT_NEG(F)});
+      differ.push_back(d);
+   }
+   satAddClause(s, differ);
+
+   int res = satSolve(S, s, tStart);
+   if (res == SAT_UNDEF) return ATPG_ABORTED;
+   if (res == 0) return ATPG_UNTESTABLE;
+
+   for (int i = 0; i < S.C.npi; i++) {
+      int v = goodVar[S.C.pi[i]->indx];
+      if (v >= 0) S[S.C.pi[i]].value = s.assign[v];
+   }
+   return ATPG_DETECTED;
+}
+
+/** @brief SAT ATPG for fault (an id).
+ * \returns like satAtpg. Writes no files.
+ */
+int satGenerate(const Circuit &C, SearchState &S, int fault) {
+   return satAtpg(S, &C.node[FAULT_NODE(fault)], FAULT_STUCK(fault));
+}
+
+/** @brief SAT command: SAT ATPG for one stuck-at fault.
+ *
+ * Arguments and output file (<circuit>_SAT_<node>@<value>.txt) are the same
+ * as for PODEM. \returns ATPG_DETECTED, ATPG_UNTESTABLE or ATPG_ABORTED.
+ */
+int sat(char *cp) {
+   char faultNode_buf[MAXLINE], faultValue_buf[MAXLINE];
+   sscanf(cp, "%s %s", faultNode_buf, faultValue_buf);
+
+   int fault = faultArg(faultNode_buf, faultValue_buf);
+   if (fault < 0) {
+      cout << "invalid argument" << endl;
+      return 1;
+   }
+   SearchState S(circuit);
+   int res = satGenerate(circuit, S, fault);
+   if (res == ATPG_DETECTED) {
+      writeTestCube(circuitName + "_SAT_" + faultNode_buf + "@" + faultValue_buf + ".txt", atpgTestCube(S));
+   }
+   return res;
+}
+
+
+// ------------------------------------- DALG ------------------------------------------------------------------
+
+// Reasons of DALG assignments, for conflict-directed backjumping. A decision
+// depends on its own level; forward and backward implications on the nodes of
+// the gate rule (rnode: the gate implied backward through) that were assigned
+// earlier; static learning on its source node rnode; recursive learning,
+// conservatively, on every level up to its own.
+#define DALG_R_DECISION 0
+#define DALG_R_FORWARD 1
+#define DALG_R_BACKWARD 2
+#define DALG_R_LEARNED 3
+#define DALG_R_RECURSIVE 4
+
+// Assignment trail: every change of a node's assign_level is recorded with the
+// value and level it replaces, so undoing a decision only visits what was
+// assigned since. dalgTrailLim[l] is where the entries of level l start, and
+// dalgDfrontLim[l] the size Dfront had at that point.
+
+/** @brief Give node indx assign_level level, recording the old value and level on the trail.
+ * Nodes still unassigned (assign_level -1) had the value X before this level set them.
+ */
+void dalgAssign(SearchState &S, int indx, int level) {
+   NSTRUC *np = &S.C.node[indx];
+   if(S[np].assign_level == level) return;
+   while(S.dalgTrailLim.size() <= level) {
+      S.dalgTrailLim.push_back(S.dalgTrail.size());
+      S.dalgDfrontLim.push_back(S.Dfront.size());
+   }
+   dalgTrailEntry e;
+   S[np].tpos = S.dalgTrail.size();
+   e.indx = indx;
+   e.value = (S[np].assign_level < 0) ? LOGIC_X : S[np].value;
+   e.level = S[np].assign_level;
+   S.dalgTrail.push_back(e);
+   S[np].assign_level = level;
+}
+
+/** @brief Undo every assignment made above level by popping the trail.
+ * D-frontier candidates added since are dropped with them.
+ */
+bool unassign(SearchState &S, int level) {  
+   if(S.dalgTrailLim.size() <= level+1) return true;
+   int start = S.dalgTrailLim[level+1];
+   while(S.dalgTrail.size() > start) {
+      dalgTrailEntry &e = S.dalgTrail.back();
+      S.node[e.indx].value = e.value;
+      S.node[e.indx].assign_level = e.level;
+      S.dalgTrail.pop_back();
+   }
+   for(int i=S.dalgDfrontLim[level+1]; i<S.Dfront.size(); i++) S.node[S.Dfront[i]].dfront = 0;
+   S.Dfront.resize(S.dalgDfrontLim[level+1]);
+   S.dalgTrailLim.resize(level+1);
+   S.dalgDfrontLim.resize(level+1);
+   return true;
+}
+
+bool check_Dfront (SearchState &S, int node){
+   NSTRUC *np; 
+   np =&S.C.node[node];
+   int Dnum=0; 
+   int Dbarnum=0, Onenum=0, Zeronum=0;
+   for(int j=0;j<(np->fin); j++ ){
+      if(S[np->unodes[j]].value == LOGIC_D) Dnum++;
+      else if(S[np->unodes[j]].value == LOGIC_DBAR) Dbarnum++;
+      else if(S[np->unodes[j]].value == LOGIC_1) Onenum++;
+      else if(S[np->unodes[j]].value == LOGIC_0) Zeronum++;
+   }
+   if( (Dnum==0 && Dbarnum==0)|| S[np].value!=LOGIC_X ||(Dnum>0 && Dbarnum>0) || (Onenum>0 && (np->type==GATE_OR || np->type==GATE_NOR || np->type==GATE_NOT || np->type==GATE_BRANCH))
+      || (Zeronum>0 && (np->type==GATE_NAND || np->type==GATE_AND || np->type==GATE_NOT || np->type==GATE_BRANCH )))
+   { return false;}
+   else { return true; }
+}
+
+/** @brief Unique sensitization for DALG.
+ * \param front The current D frontier.
+ * \returns -1 if a side input of a dominator common to the D frontier already
+ * holds its controlling value, otherwise the number of side inputs it assigned
+ * their non-controlling value (pushed on imply).
+ *
+ * Called after every implication, so the assignments are made right after
+ * fault activation and again whenever the D frontier shrinks.
+ */
+int dalgSensitize(SearchState &S, const vector<int> &front) {
+   NSTRUC *dom = NULL;
+   bool first = true;
+   for(int i=0; i<front.size(); i++) {
+      NSTRUC *np = &S.C.node[front[i]];
+      dom = first ? np : domIntersect(dom, np);
+      first = false;
+   }
+   S.sensitizeObj.clear();
+   if(!sensitizeDominators(S, dom, S.sensitizeObj)) return -1;
+   int n = 0;
+   for(int i=0; i<S.sensitizeObj.size(); i++) {
+      if(S[S.sensitizeObj[i].first].value != LOGIC_X) continue;   // listed twice
+      S[S.sensitizeObj[i].first].value = S.sensitizeObj[i].second;
+      S.imply.push_back(S.sensitizeObj[i].first->indx);
+      n++;
+   }
+   return n;
+}
+
+/** @brief The current D frontier: the candidates on Dfront that are still X with a fault effect on an input.
+ *
+ * A gate becomes a candidate when one of its inputs takes D or D', and the
+ * candidates are dropped again by unassign(), so the frontier is kept up to
+ * date by the implication instead of being searched from the fault site.
+ */
+void getDfront(SearchState &S, vector<int> &front){
+   front.clear();
+   for(int i=0; i<S.Dfront.size(); i++) {
+      if(check_Dfront(S, S.Dfront[i])) front.push_back(S.Dfront[i]);
+   }
+}
+
+/** @brief Value of Gate* g implied by its inputs, with the fault applied at the site.
+ */
+int dalgEval(SearchState &S, NSTRUC* g) {
+   return applyFault(S, g, simGate(S, g));
+}
+
+/** @brief Nodes whose values implied Gate* n by rule kind (through Gate* r), among those assigned before trail position tpos.
+ */
+void dalgAntecedents(SearchState &S, NSTRUC* n, int kind, NSTRUC* r, int tpos, vector<NSTRUC *> &out) {
+   if(kind == DALG_R_FORWARD) {
+      for(int i=0; i<n->fin; i++) {
+         NSTRUC *u = n->unodes[i];
+         if(S[u].value != LOGIC_X && S[u].tpos < tpos) out.push_back(u);
+      }
+   }
+   else if(kind == DALG_R_BACKWARD) {
+      out.push_back(r);
+      for(int i=0; i<r->fin; i++) {
+         NSTRUC *u = r->unodes[i];
+         if(u != n && S[u].value != LOGIC_X && S[u].tpos < tpos) out.push_back(u);
+      }
+   }
+   else if(kind == DALG_R_LEARNED) {
+      out.push_back(r);
+   }
+}
+
+/** @brief Record a conflict between Gate* g and its assigned inputs.
+ */
+void dalgGateConflict(SearchState &S, NSTRUC* g) {
+   S.dalgConflictSeeds.clear();
+   dalgAntecedents(S, g, DALG_R_FORWARD, NULL, INT_MAX, S.dalgConflictSeeds);
+   S.dalgConflictSeeds.push_back(g);
+}
+
+/** @brief Assign value v to Gate* np at level for reason kind (through Gate* r) and queue it for implication.
+ * \returns false if np already holds a different value; the conflict is recorded.
+ */
+bool dalgSet(SearchState &S, NSTRUC* np, int v, int level, int kind, NSTRUC* r) {
+   if(S[np].value == v) return true;
+   if(S[np].value != LOGIC_X) {
+      S.dalgConflictSeeds.clear();
+      dalgAntecedents(S, np, kind, r, INT_MAX, S.dalgConflictSeeds);
+      S.dalgConflictSeeds.push_back(np);
+      return false;
+   }
+   S[np].value = v;
+   dalgAssign(S, np->indx, level);
+   S[np].rkind = kind;
+   S[np].rnode = (r == NULL) ? -1 : r->indx;
+   if(!S[np].inqueue) {
+      S[np].inqueue = 1;
+      S.dalgQueue.push_back(np->indx);
+   }
+   return true;
+}
+
+
+/** @brief Input rails forced by one rail of a gate output (0/1) in three-valued logic.
+ * \param rail Current rail value of every input (0, 1 or RAIL_X); forced inputs are overwritten.
+ * \returns false if the inputs cannot produce out.
+ */
+bool railBackward(int type, int out, vector<int> &rail) {
+   int n = rail.size();
+   switch(type) {
+   case GATE_BRANCH:
+   case GATE_NOT: {
+      int need = (type == GATE_NOT) ? 1 - out : out;
+      if(rail[0] != RAIL_X && rail[0] != need) return false;
+      rail[0] = need;
+      return true;
+   }
+   case GATE_AND:
+   case GATE_NAND:
+   case GATE_OR:
+   case GATE_NOR: {
+      int c = (type == GATE_AND || type == GATE_NAND) ? 0 : 1;
+      int inv = (type == GATE_NAND || type == GATE_NOR);
+      if((out ^ inv) != c) {
+         // non-controlled output: every input is non-controlling
+         for(int i=0; i<n; i++) {
+            if(rail[i] == c) return false;
+            rail[i] = 1 - c;
+         }
+         return true;
+      }
+      int xnum = 0, xind = -1;
+      for(int i=0; i<n; i++) {
+         if(rail[i] == c) return true;
+         if(rail[i] == RAIL_X) { xnum++; xind = i; }
+      }
+      if(xnum == 0) return false;
+      if(xnum == 1) rail[xind] = c;
+      return true;
+   }
+   case GATE_XOR: {
+      int xnum = 0, xind = -1, parity = out;
+      for(int i=0; i<n; i++) {
+         if(rail[i] == RAIL_X) { xnum++; xind = i; }
+         else parity ^= rail[i];
+      }
+      if(xnum == 0) return parity == 0;
+      if(xnum == 1) rail[xind] = parity;
+      return true;
+   }
+   default: break;
+   }
+   return true;
+}
+
+/** @brief Backward implication: assign the inputs of Gate* g that its value forces.
+ * \returns false on a conflict.
+ *
+ * The good and the faulty machine are implied rail by rail. Outside the fault
+ * cone both rails are one binary value; inside it an input is only assigned
+ * once both of its rails are known. At the site only the good rail is implied,
+ * since the faulty one is the stuck value.
+ */
+bool dalgBackward(SearchState &S, NSTRUC* g, int level) {
+   if(g->fin == 0 || S[g].value == LOGIC_X) return true;
+   int code = logicCode(S[g].value);
+   bool site = (S[g].fault != NOFAULT);
+   bool cone = (S[g].fcone == S.coneStamp) && !site;
+   vector<int> good(g->fin), faulty(g->fin);
+   for(int i=0; i<g->fin; i++) {
+      int c = logicCode(S[g->unodes[i]].value);
+      good[i] = c / 3;
+      faulty[i] = c % 3;
+   }
+   if(!railBackward(g->type, code / 3, good) || (cone && !railBackward(g->type, code % 3, faulty))) {
+      dalgGateConflict(S, g);
+      return false;
+   }
+   for(int i=0; i<g->fin; i++) {
+      NSTRUC *in = g->unodes[i];
+      int gv = good[i], fv = cone ? faulty[i] : gv;
+      if(S[in].fcone != S.coneStamp) {
+         // good and faulty machine agree outside the cone
+         if(gv == RAIL_X) gv = fv;
+         if(fv == RAIL_X) fv = gv;
+         if(gv != fv) {
+            dalgGateConflict(S, g);
+            return false;
+         }
+      }
+      int v = codeToLogic(3 * gv + fv);
+      if(v != LOGIC_X && !dalgSet(S, in, v, level, DALG_R_BACKWARD, g)) return false;
+   }
+   return true;
+}
+
+/** @brief Forward and backward implication of Gate* g.
+ * \returns false on a conflict.
+ *
+ * If the inputs already imply a value, g takes it (or conflicts) and leaves
+ * nothing to imply backward; otherwise an assigned g forces what it can onto
+ * its inputs.
+ */
+bool dalgImplyGate(SearchState &S, NSTRUC* g, int level) {
+   if(g->fin == 0) return true;
+   int v = dalgEval(S, g);
+   if(v != LOGIC_X) return dalgSet(S, g, v, level, DALG_R_FORWARD, NULL);
+   return dalgBackward(S, g, level);
+}
+
+/** @brief Apply the implications learned for the binary value of Gate* g (DALG imply).
+ * \returns false on a conflict.
+ *
+ * Implied values are assigned only outside the fault cone; inside it they are
+ * still checked against the good-machine value.
+ */
+bool learnImply(SearchState &S, NSTRUC* g, int level) {
+  if (S.C.learnStart == NULL) return true;
+  int lit = 2 * g->indx + S[g].value;
+  for (int i = S.C.learnStart[lit]; i < S.C.learnStart[lit + 1]; i++) {
+    NSTRUC* m = &S.C.node[S.C.learnTarget[i] >> 1];
+    int w = S.C.learnTarget[i] & 1;
+    if (S[m].value == LOGIC_X) {
+      if (S[m].fcone != S.coneStamp && !dalgSet(S, m, w, level, DALG_R_LEARNED, g)) return false;
+    }
+    else if (goodValue(S[m].value) != w) {
+      S.dalgConflictSeeds.assign(1, m);
+      S.dalgConflictSeeds.push_back(g);
+      return false;
+    }
+  }
+  return true;
+}
+
+/** @brief Worklist implication of the nodes queued on dalgQueue, assigning at level.
+ * \returns false on a conflict.
+ *
+ * Each node whose value changed is queued once (inqueue) and, when processed,
+ * implied from and onto its inputs, implied forward onto its fanouts, and
+ * given its learned implications. Fanouts of a new fault effect become
+ * D-frontier candidates.
+ */
+bool dalgPropagate(SearchState &S, int level) {
+   bool ok = true;
+   for(int qi=0; qi<S.dalgQueue.size(); qi++) {
+      NSTRUC *np = &S.C.node[S.dalgQueue[qi]];
+      S[np].inqueue = 0;
+      if(!ok) continue;
+      // implications learned statically for this value
+      if(S[np].value == LOGIC_0 || S[np].value == LOGIC_1) ok = learnImply(S, np, level);
+      if(S[np].value == LOGIC_D || S[np].value == LOGIC_DBAR) {
+         for(int k=0; k<np->fout; k++) {
+            NSTRUC *d = np->dnodes[k];
+            if(S[d].value == LOGIC_X && !S[d].dfront) {
+               S[d].dfront = 1;
+               S.Dfront.push_back(d->indx);
             }
-            // check
-            else if(np_out->value==LOGIC_0) {
-               if (!(Onenum>0 ||  (Dnum>0&& Dbarnum>0))) {
-                  return false;
-               }
-            } else if (np_out->value==LOGIC_1) {
-               if (!(Xnum==0 && Zeronum==np_out->fin)) {
-                  return false;
-               }
+         }
+      }
+      ok = ok && dalgImplyGate(S, np, level);
+      for(int k=0; ok && k<np->fout; k++) ok = dalgImplyGate(S, np->dnodes[k], level);
+   }
+   S.dalgQueue.clear();
+   return ok;
+}
+
+/** @brief Recursive learning (Kunz-Pradhan) on the unjustified gates assigned from trail position from.
+ * \param level Level the necessary assignments are made at.
+ * \param depth Recursion depth of this call, from 1 up to settings.depth.
+ * \returns false if every justification of some gate conflicts.
+ *
+ * An AND/OR type gate outside the fault cone whose output holds the controlled
+ * value can be justified by any of its X inputs taking the controlling value.
+ * Each choice is implied in turn one level above (and learned from again while
+ * depth < settings.depth), then undone; the assignments common to every
+ * consistent choice are necessary and are made at level.
+ */
+bool dalgRecursiveLearn(SearchState &S, int level, int depth, int from) {
+   for(int t=from; t<S.dalgTrail.size(); t++) {
+      NSTRUC *g = &S.C.node[S.dalgTrail[t].indx];
+      int c = controllingValue(g);
+      if(c == LOGIC_X || S[g].fcone == S.coneStamp || S[g].value == LOGIC_X) continue;
+      int inv = (g->type == GATE_NAND || g->type == GATE_NOR);
+      if((S[g].value ^ inv) != c || dalgEval(S, g) != LOGIC_X) continue;
+
+      int tl = level + 1;
+      bool any = false;
+      vector<pair<int,int> > common, implied;
+      for(int j=0; j<g->fin; j++) {
+         NSTRUC *u = g->unodes[j];
+         if(S[u].value != LOGIC_X) continue;
+         int mark = S.dalgTrail.size();
+         bool ok = dalgSet(S, u, c, tl, DALG_R_DECISION, NULL) && dalgPropagate(S, tl)
+                   && (depth >= S.settings.depth || dalgRecursiveLearn(S, tl, depth+1, mark));
+         if(ok) {
+            implied.clear();
+            for(int k=mark; k<S.dalgTrail.size(); k++) {
+               implied.push_back(make_pair(S.dalgTrail[k].indx, S.node[S.dalgTrail[k].indx].value));
             }
-         }//nor
-
-         else if(np_out->type==GATE_NAND){
-            //try to imply
-            if(np_out->value ==LOGIC_X ) {
-               if(Zeronum>0 ||  (Dnum>0&& Dbarnum>0)) {
-                  np_out->value=LOGIC_1; 
-                  imply.push_back(np_out->indx);
-               } else if(Xnum==0 && Onenum==np_out->fin) {
-                  np_out->value=LOGIC_0; 
-                  imply.push_back(np_out->indx);
-               } else if((Onenum+Dnum) == np_out->fin) {
-                  np_out->value=LOGIC_DBAR; 
-                  imply.push_back(np_out->indx);
-               } else if((Onenum+Dbarnum) == np_out->fin) {
-                  np_out->value=LOGIC_D; 
-                  imply.push_back(np_out->indx);
-               }
+            sort(implied.begin(), implied.end());
+            if(!any) {
+               common = implied;
             }
-            // check
-            else if (np_out->value==LOGIC_1) { 
-               if(!(Zeronum>0 ||  (Dnum>0&& Dbarnum>0))) return false;
-            } else if (np_out->value==LOGIC_0) {
-               if(!(Xnum==0 && Onenum==np_out->fin)) return false;
+            else {
+               vector<pair<int,int> > both;
+               set_intersection(common.begin(), common.end(), implied.begin(), implied.end(), back_inserter(both));
+               common.swap(both);
             }
-         }//nand
-      
-         else if(np_out->type==GATE_AND){
-            //try to imply
-               if(np_out->value ==LOGIC_X ) { 
-                     if(Zeronum>0 ||  (Dnum>0&& Dbarnum>0))    {np_out->value=LOGIC_0; imply.push_back(np_out->indx);}
-                     else if(Xnum==0 && Onenum==np_out->fin)   {np_out->value=LOGIC_1; imply.push_back(np_out->indx);}
-                     else if( (Onenum+Dnum) == np_out->fin)    {np_out->value=LOGIC_D; imply.push_back(np_out->indx);}
-                     else if( (Onenum+Dbarnum) == np_out->fin) {np_out->value=LOGIC_DBAR; imply.push_back(np_out->indx);}
-               }
-               // check
-               else if(np_out->value==LOGIC_0) { if(!(Zeronum>0 ||  (Dnum>0&& Dbarnum>0))) return false;}
-               else if(np_out->value==LOGIC_1) {if(!(Xnum==0 && Onenum==np_out->fin)) return false;}
-         }//and
-      }  								
-	}
-   
+            any = true;
+         }
+         unassign(S, level);
+         S.dalgConflictAll = false;
+         if(any && common.empty()) break;
+      }
+      if(!any) {
+         S.dalgConflictAll = true;
+         return false;
+      }
+      for(int k=0; k<common.size(); k++) {
+         if(!dalgSet(S, &S.C.node[common[k].first], common[k].second, level, DALG_R_RECURSIVE, NULL)) return false;
+      }
+      if(!common.empty() && !dalgPropagate(S, level)) return false;
+   }
    return true;
 }
 
+/** @brief DALG implication of the decisions on imply at level.
+ * \returns false on a conflict.
+ *
+ * The decisions are propagated by dalgPropagate(), then recursive learning
+ * (up to settings.depth, 0 = off) adds the assignments every justification of
+ * an unjustified gate agrees on, so conflicts show before Dalg() branches.
+ */
+bool imply_and_check(SearchState &S, int level){
+   S.dalgQueue.clear();
+   S.dalgConflictSeeds.clear();
+   S.dalgConflictAll = false;
+   for(int kk=0; kk<S.imply.size(); kk++) {
+      NSTRUC *np = &S.C.node[S.imply[kk]];
+      dalgAssign(S, np->indx, level);
+      S[np].rkind = DALG_R_DECISION;
+      if(!S[np].inqueue) {
+         S[np].inqueue = 1;
+         S.dalgQueue.push_back(np->indx);
+      }
+   }
+   S.imply.clear();
 
-bool Dalg(int level) {
-	
-   int time_elapsed = (clock() - dalg_recursion_tStart)/(CLOCKS_PER_SEC);
-   if (time_elapsed > 1) {
-      return false;
+   if(!dalgPropagate(S, level)) return false;
+   return S.settings.depth == 0 || dalgRecursiveLearn(S, level, 1, 0);
+}
+
+/** @brief The unjustified gate to justify next: assigned, but not implied by its
+ * inputs yet, with the highest SCOAP controllability of its (good) value. NULL if none.
+ */
+NSTRUC* dalgJustifyGate(SearchState &S) {
+   NSTRUC *best = NULL;
+   int bestCost = -1;
+   for(int i=0; i<S.dalgTrail.size(); i++) {
+      NSTRUC *np = &S.C.node[S.dalgTrail[i].indx];
+      if(S[np].value == LOGIC_X || np->fin == 0 || dalgEval(S, np) != LOGIC_X) continue;
+      int cost = (goodValue(S[np].value) == LOGIC_0) ? np->cc0 : np->cc1;
+      if(cost > bestCost) {
+         best = np;
+         bestCost = cost;
+      }
    }
+   return best;
+}
 
+/** @brief Make dalgWhy every level up to level (a failure whose cause is not tracked).
+ */
+void dalgWhyAll(SearchState &S, int level) {
+   S.dalgWhy.assign(level+1, 1);
+}
+
+bool dalgWhyHas(SearchState &S, int level) {
+   return level < S.dalgWhy.size() && S.dalgWhy[level];
+}
 
-	// Dalg_count++;
-	// if(Dalg_count> 20000) return false;
-	for ( int kk=0;kk< Nnodes;kk++) {
-	   if( Node[kk].assign_level > level) {
-         Node[kk].value=LOGIC_X; 
-         Node[kk].assign_level=-1;
+/** @brief Conflict analysis: the decision levels the last implication conflict at level depends on, into dalgWhy.
+ *
+ * Walks the reasons back from the conflicting nodes to the decisions.
+ */
+void dalgAnalyze(SearchState &S, int level) {
+   if(S.dalgConflictAll || S.dalgConflictSeeds.empty()) {
+      dalgWhyAll(S, level);
+      return;
+   }
+   S.dalgWhy.assign(level+1, 0);
+   S.dalgWhyStamp++;
+   vector<NSTRUC *> stack;
+   for(int i=0; i<S.dalgConflictSeeds.size(); i++) {
+      NSTRUC *np = S.dalgConflictSeeds[i];
+      if(S[np].whystamp == S.dalgWhyStamp) continue;
+      S[np].whystamp = S.dalgWhyStamp;
+      stack.push_back(np);
+   }
+   while(!stack.empty()) {
+      NSTRUC *np = stack.back();
+      stack.pop_back();
+      int l = S[np].assign_level;
+      if(l < 0) continue;
+      if(l >= S.dalgWhy.size()) S.dalgWhy.resize(l+1, 0);
+      if(S[np].rkind == DALG_R_DECISION) {
+         S.dalgWhy[l] = 1;
       }
-	}
+      else if(S[np].rkind == DALG_R_RECURSIVE) {
+         for(int k=0; k<=l; k++) S.dalgWhy[k] = 1;
+      }
+      else {
+         vector<NSTRUC *> ante;
+         dalgAntecedents(S, np, S[np].rkind, (S[np].rnode < 0) ? NULL : &S.C.node[S[np].rnode], S[np].tpos, ante);
+         for(int i=0; i<ante.size(); i++) {
+            if(S[ante[i]].whystamp == S.dalgWhyStamp) continue;
+            S[ante[i]].whystamp = S.dalgWhyStamp;
+            stack.push_back(ante[i]);
+         }
+      }
+   }
+}
+
+
+/** @brief DALG decision search at level.
+ * \returns true when a test is found. On failure dalgWhy holds the decision
+ * levels responsible: a failure that does not involve the decision made for
+ * level+1 cannot be fixed by the other alternatives here, so the search jumps
+ * back over this level (conflict-directed backjumping).
+ */
+bool Dalg(SearchState &S, int level) {
+	
+   if (S.dalgAborted || atpgBudgetExceeded(S, S.Dalg_count, S.dalg_tStart)) {
+      S.dalgAborted = true;
+      return false;
+   }
 
-	if(imply_and_check()) {
-		for(int kk=0; kk< imply.size(); kk++) { 
-         Node[imply[kk]].assign_level=level;  
-      }  
-		//getDfront();
-	} else {
-		for(int i=0; i<imply.size(); i++ ){  
-         Node[imply[i]].value=LOGIC_X; 
-         Node[imply[i]].assign_level=-1; 
-      }
-	   imply.clear(); 
+	unassign(S, level);
+	if(!imply_and_check(S, level)) {
+      dalgAnalyze(S, level);
+      unassign(S, level-1);
       return false;
    }
 
-   imply.clear();
-   getDfront();
+   vector<int> front;
+   getDfront(S, front);
    bool DatOut=false;
    NSTRUC *np;
-   for(int i = 0; i<Npo; i++) {  // check D or D' at output
-      if(Poutput[i]->value==LOGIC_D||Poutput[i]->value==LOGIC_DBAR) {
+   for(int i = 0; i<S.C.npo; i++) {  // check D or D' at output
+      if(S[S.C.po[i]].value==LOGIC_D||S[S.C.po[i]].value==LOGIC_DBAR) {
          DatOut=true;
       }
    }
    // propagate D frontier to output
    if(!DatOut) {
-      if(Dfront.size()==0) {
-         unassign(level-1); 
+      if(front.size()==0) {
+         dalgWhyAll(S, level);
+         unassign(S, level-1); 
          return false;
-      } else {
-         int iter_while= 0;
-         for(int i = 0; i<Dfront.size(); i++) {
-         
-         np = &Node[Dfront[i]];
-         
-         int Dnum=0; 
-         int Dbarnum=0, Onenum=0, Zeronum=0;
-         for(int j=0;j<(np->fin); j++ ) {
-            if(np->unodes[j]->value == LOGIC_D) Dnum++;
-            else if(np->unodes[j]->value == LOGIC_DBAR) Dbarnum++;
-            else if(np->unodes[j]->value == LOGIC_1) Onenum++;
-            else if(np->unodes[j]->value == LOGIC_0) Zeronum++;
-         }
-         
-         if ( (Dnum==0 && Dbarnum==0)|| np->value!=LOGIC_X ||(Dnum>0 && Dbarnum>0) ) {
-            continue;
-         }
-         
-         if(Dnum>0) {
-            if(np->type == GATE_OR || np->type== GATE_AND || np->type==GATE_BRANCH || np->type==GATE_XOR)      {   np->value=LOGIC_D; } 
-            else if(np->type ==GATE_NOR || np->type==GATE_NAND || np->type==GATE_NOT) {   np->value=LOGIC_DBAR; }
-            
-            imply.push_back(np->indx);
-            for(int j=0;j<(np->fin); j++ ){
-               if( np->unodes[j]->value == LOGIC_X) {
-                  if(np->type == GATE_OR || np->type==GATE_NOR || np->type==GATE_XOR) { np->unodes[j]->value=LOGIC_0; } 
-            else if(np->type ==GATE_NAND || np->type==GATE_AND) { np->unodes[j]->value=LOGIC_1; }
-            imply.push_back(np->unodes[j]->indx);
-            }
-         }	
-
-            
+      }
+      // unique sensitization: assign the side inputs of the common dominators first
+      int sensitized = dalgSensitize(S, front);
+      if(sensitized < 0) {
+         dalgWhyAll(S, level);
+         unassign(S, level-1);
+         return false;
+      }
+      else if(sensitized > 0) {
+         if(Dalg(S, level+1)) return true;
+         if(dalgWhyHas(S, level+1)) dalgWhyAll(S, level);
+         unassign(S, level-1);
+         return false;
+      }
+      for(int i = 0; i<front.size(); i++) {
+         np = &S.C.node[front[i]];
+         // Side inputs of an AND/OR type gate outside the fault cone must take the
+         // non-controlling value. An XOR side input may take either value, and one
+         // inside the cone may also carry the same fault effect, so the first such
+         // input is decided here and the others stay X for the next level.
+         int c = controllingValue(np);
+         int effect = LOGIC_X;
+         NSTRUC *choice = NULL;
+         for(int j=0;j<(np->fin); j++ ){
+            NSTRUC *u = np->unodes[j];
+            if(S[u].value == LOGIC_D || S[u].value == LOGIC_DBAR) effect = S[u].value;
+            else if(S[u].value == LOGIC_X && choice == NULL && (c == LOGIC_X || S[u].fcone == S.coneStamp)) choice = u;
          }
-         else if(Dbarnum>0) {
-            if(np->type == GATE_OR || np->type==GATE_AND  || np->type==GATE_BRANCH || np->type==GATE_XOR)      {   np->value=LOGIC_DBAR; } 
-            else if(np->type ==GATE_NOR || np->type==GATE_NAND || np->type==GATE_NOT) {   np->value=LOGIC_D; }
-            
-            imply.push_back(np->indx);
+         int choices[2] = {(c == LOGIC_X) ? LOGIC_0 : 1 - c, (c == LOGIC_X) ? LOGIC_1 : effect};
+         int nchoices = (choice == NULL) ? 1 : 2;
+         for(int k=0; k<nchoices; k++) {
             for(int j=0;j<(np->fin); j++ ){
-            if( np->unodes[j]->value ==LOGIC_X){
-            
-                              if(np->type ==GATE_OR || np->type==GATE_NOR || np->type==GATE_XOR) { np->unodes[j]->value=LOGIC_0; } 
-            else if(np->type == GATE_NAND || np->type==GATE_AND) { np->unodes[j]->value=LOGIC_1; }
-            imply.push_back(np->unodes[j]->indx);
+               NSTRUC *u = np->unodes[j];
+               if(S[u].value != LOGIC_X || (u != choice && (c == LOGIC_X || S[u].fcone == S.coneStamp))) continue;
+               S[u].value = (u == choice) ? choices[k] : 1 - c;
+               S.imply.push_back(u->indx);
             }
-         }
-         
-         }
-         int pop_ind=Dfront[0];
-         
-            if(Dalg(level+1)) {
+            if(S.imply.empty()) break;
+            if(Dalg(S, level+1)) {
                return true;
-            } else {  
-               unassign(level); 
-               getDfront();
             }
+            S.Dalg_count++;
+            if(!dalgWhyHas(S, level+1)) {
+               unassign(S, level-1);
+               return false;
+            }
+            unassign(S, level); 
          }
-         unassign(level-1);
-         return false;
       }
+      // which gates are on the D frontier depends on everything assigned so far
+      dalgWhyAll(S, level);
+      unassign(S, level-1);
+      return false;
    }
-	//check Jfront
-	vector<int> temp2; temp2.clear();
-	for(int i=0;i <Jfront.size();i++){
-	      int Xnum=0;
-			int Dnum=0;
-			int Dbarnum=0;
-			int Onenum=0;
-			int Zeronum=0;
-			np = &Node[Jfront[i]];
-			for(int j=0;j< np->fin ;j++){
-													if      (np->unodes[j]->value==LOGIC_X) Xnum++;
-													else if (np->unodes[j]->value==LOGIC_D) Dnum++;
-													else if (np->unodes[j]->value==LOGIC_DBAR) Dbarnum++;
-													else if (np->unodes[j]->value==LOGIC_1) Onenum++; 
-													else if (np->unodes[j]->value==LOGIC_0) Zeronum++;
-			}
-			if(Node[Jfront[i]].value==LOGIC_1 && np->type==GATE_OR) { // or 
-				if(Xnum>0 && !(Dnum>0&& Dbarnum>0) && Onenum==0) {temp2.push_back(Jfront[i]);}
-			}
-			else if(Node[Jfront[i]].value==LOGIC_1 && np->type==GATE_NAND) { //  nand
-				if(Xnum>0 && !(Dnum>0&& Dbarnum>0) && Zeronum==0) {temp2.push_back(Jfront[i]);}
-			}
-			else if(Node[Jfront[i]].value==LOGIC_0 && np->type==GATE_NOR){ // nor
-				if(Xnum>0 && !(Dnum>0&& Dbarnum>0) && Onenum==0 ) {temp2.push_back(Jfront[i]);}
-			}
-			else if(Node[Jfront[i]].value==LOGIC_0 && np->type==GATE_AND){ //and
-				if(Xnum>0 && !(Dnum>0&& Dbarnum>0) && Zeronum==0) {temp2.push_back(Jfront[i]);}
-			}
+
+	// justify the hardest gate first (highest SCOAP controllability of its value)
+	np = dalgJustifyGate(S);
+	if(np == NULL) return true;
+
+	// decide the X input that is easiest to set to the controlling value
+	int c = controllingValue(np);
+	NSTRUC *in = NULL;
+	for(int j=0;j< np->fin ;j++){
+		NSTRUC *u = np->unodes[j];
+		if(S[u].value != LOGIC_X) continue;
+		int cost = (c == LOGIC_1) ? u->cc1 : (c == LOGIC_0) ? u->cc0 : min(u->cc0, u->cc1);
+		int best = (in == NULL) ? 0 : (c == LOGIC_1) ? in->cc1 : (c == LOGIC_0) ? in->cc0 : min(in->cc0, in->cc1);
+		if(in == NULL || cost < best) in = u;
 	}
-	Jfront= temp2;
-	if(temp2.size()==0) return true;
-	for(int i=0;i <temp2.size();i++){
-			int Xnum=0;
-			int Dnum=0;
-			int Dbarnum=0;
-			int Onenum=0;
-			int Zeronum=0;
-			np = &Node[temp2[i]];
-			for(int j=0;j< np->fin ;j++){
-			    if(np->unodes[j]->value==LOGIC_X){
-					if(np->type==GATE_OR || np->type==GATE_NOR){
-					    np->unodes[j]->value =  LOGIC_1;   imply.push_back(np->unodes[j]->indx);	
-						 if(Dalg(level+1)) {return true;} else { unassign(level);}
-						np->unodes[j]->value =  LOGIC_0;   imply.push_back(np->unodes[j]->indx);
-						np->unodes[j]->assign_level= level;
-
-					}
-					else if(np->type==GATE_AND || np->type==GATE_NAND){
-						 np->unodes[j]->value = LOGIC_0;   imply.push_back(np->unodes[j]->indx);	
-						 if(Dalg(level+1)) {return true;} else { unassign(level);}
-						 np->unodes[j]->value =  LOGIC_1;   imply.push_back(np->unodes[j]->indx);
-						 np->unodes[j]->assign_level= level;
-						 
-					}
-				}
-			}
-			imply.clear();
-			unassign(level-1);
+	if(c == LOGIC_X) c = (in->cc0 <= in->cc1) ? LOGIC_0 : LOGIC_1;
+	// inside the fault cone the input may also carry a fault effect
+	int choices[4] = {c, 1 - c, LOGIC_D, LOGIC_DBAR};
+	int nchoices = (S[in].fcone == S.coneStamp) ? 4 : 2;
+	// every value of the input fails: the causes are those of the alternatives
+	vector<char> why;
+	for(int k=0; k<nchoices; k++) {
+		S[in].value = choices[k];
+		S.imply.push_back(in->indx);
+		if(Dalg(S, level+1)) return true;
+		S.Dalg_count++;
+		if(!dalgWhyHas(S, level+1)) {
+			unassign(S, level-1);
 			return false;
+		}
+		if(why.size() < S.dalgWhy.size()) why.resize(S.dalgWhy.size(), 0);
+		for(int l=0; l<=level && l<S.dalgWhy.size(); l++) why[l] |= S.dalgWhy[l];
 	}
+	why.resize(level+1, 0);
+	S.dalgWhy.swap(why);
+	unassign(S, level-1);
+	return false;
 }
 
 
 
-bool DalgCall(pair<int,int> fault){
+bool DalgCall(SearchState &S, pair<int,int> fault){
 
-	Dfront.clear();
-	Jfront.clear(); 
-   imply.clear();
-   dalg_recursion_tStart = clock();
-	Dalg_count=0;
-   for(int kk=0;kk< Nnodes; kk++){
-      Node[kk].value= LOGIC_X; 
-      Node[kk].assign_level = -1;
-   }
-   NSTRUC *np =&Node[(int) (fault.first)];
-	check_fault = fault;
-   for(int kk=0;kk< np->fout;kk++){
-      Dfront.push_back(np->dnodes[kk]->indx);      // setup d frontier
+	S.Dfront.clear();
+   S.imply.clear();
+   S.dalgTrail.clear();
+   S.dalgTrailLim.clear();
+   S.dalgDfrontLim.clear();
+   S.dalg_tStart = std::chrono::steady_clock::now();
+	S.Dalg_count=0;
+	S.dalgAborted = false;
+   for(int kk=0;kk< S.C.nnodes; kk++){
+      S.node[kk].value= LOGIC_X; 
+      S.node[kk].fault = NOFAULT;
+      S.node[kk].assign_level = -1;
+      S.node[kk].inqueue = 0;
+      S.node[kk].dfront = 0;
    }
-	if (fault.second == 0) {
-      np->value= LOGIC_D; 
-      if(np->type==GATE_BRANCH) {
-         np->unodes[0]->value=LOGIC_1; 
-      }
-      imply.push_back(np->indx);
-   } else {  
-      np->value= LOGIC_DBAR; 
-      if(np->type==GATE_BRANCH) {
-         np->unodes[0]->value=LOGIC_0; 
-      }
-      imply.push_back(np->indx);
-   }//D 
+   NSTRUC *np =&S.C.node[(int) (fault.first)];
+   markFaultCone(S, np);
+   // the site's fanouts become the D frontier and its inputs are implied
+   // from the good value by the first implication
+   S[np].fault = fault.second;
+   S[np].value = (fault.second == FAULT_SA0) ? LOGIC_D : LOGIC_DBAR;
+   S.imply.push_back(np->indx);
 	
-	bool find=Dalg(0);
+	bool find=Dalg(S, 0);
    
-   if(find) { 
-      vector<int> temp; 
-      temp.clear();
-      for(int i=0;i<Npi  ;i++){
-         if(Pinput[i]->value==LOGIC_D) {
-            temp.push_back(1);
-         } else if(Pinput[i]->value==LOGIC_DBAR) {
-            temp.push_back(0);
-         } else {
-            temp.push_back(Pinput[i]->value);
-         }
+   return find;
+}
+
+
+/** @brief DALG for fault (an id).
+ * \returns ATPG_DETECTED with the test in the PI values of S, ATPG_UNTESTABLE
+ * or ATPG_ABORTED. Writes no files.
+ */
+int dalgGenerate(const Circuit &C, SearchState &S, int fault) {
+   if (DalgCall(S, make_pair(FAULT_NODE(fault), FAULT_STUCK(fault)))) return ATPG_DETECTED;
+   return S.dalgAborted ? ATPG_ABORTED : ATPG_UNTESTABLE;
+}
+
+int dalg (char *cp) {
+
+   char faultNode_buf[MAXLINE], faultValue_buf[MAXLINE], depth_buf[MAXLINE];
+   int nargs = sscanf(cp, "%s %s %s", faultNode_buf, faultValue_buf, depth_buf);
+   // optional recursive learning depth
+   AtpgSettings settings;
+   if (nargs >= 3) settings.depth = stoi(depth_buf);
+
+   int fault = faultArg(faultNode_buf, faultValue_buf);
+   if (fault < 0) {
+      cout << "invalid argument" << endl;
+      return 1;
+   }
+   SearchState S(circuit, settings);
+   int res = dalgGenerate(circuit, S, fault);
+   if (res == ATPG_DETECTED) {
+      writeTestCube(circuitName + "_DALG_" + faultNode_buf + "@" + faultValue_buf + ".txt", atpgTestCube(S));
+   }
+   return res;
+}
+
+
+// ------------------------------------- Fault-parallel ATPG --------------------------------------------------
+// What READ builds is the Circuit; it is not written during test generation.
+// Everything an engine writes is in the SearchState it is given, so a worker
+// thread only needs a SearchState of its own.
+
+// PORTFOLIO races these engines on every fault, each on its own SearchState;
+// the first to find a test or prove the fault untestable wins and cancels the
+// others. Every scheduler worker owns a pool of engine threads that lives as
+// long as the schedule, sized so that workers x engine threads stays within
+// the cores. With fewer threads than engines the engines still take their
+// turns in the order below, so a single thread runs them as a fallback chain.
+const char *atpgPortfolio[] = {"DALG", "FAN", "PODEM", "SAT"};
+#define ATPG_PORTFOLIO_SIZE 4
+
+struct AtpgRacePool {
+   vector<SearchState> states;    // one per portfolio engine
+   vector<thread> threads;
+   mutex lock;
+   condition_variable wake, finished;
+   bool quit;
+   // the race being run
+   int fault;
+   int nextEngine;                // next engine to start, ATPG_PORTFOLIO_SIZE when none is left
+   int running;                   // engines searching
+   int winner, res;
+   vector<int> cube;
+   atomic<bool> cancel;
+};
+
+/** @brief Is alg an engine ATPG_DET and ATPG can run (PODEM, FAN, SAT, DALG or PORTFOLIO)? */
+bool atpgEngineKnown(const string &alg) {
+   if (alg == "PORTFOLIO") return true;
+   for (int e = 0; e < ATPG_PORTFOLIO_SIZE; e++) {
+      if (alg == atpgPortfolio[e]) return true;
+   }
+   return false;
+}
+
+/** @brief Run engine alg (PODEM, FAN, SAT or DALG) on fault (an id) in S.
+ * A test found is left in the PI values of S.
+ */
+int atpgGenerate(const Circuit &C, SearchState &S, const string &alg, int fault) {
+   if (alg == "DALG") return dalgGenerate(C, S, fault);
+   if (alg == "FAN") return fanGenerate(C, S, fault);
+   if (alg == "SAT") return satGenerate(C, S, fault);
+   return podemGenerate(C, S, fault);
+}
+
+
+/** @brief Engine thread of a race pool: runs the engines of every race it can
+ * take, each on the engine's own SearchState, until the pool quits.
+ */
+void atpgRaceThread(AtpgRacePool *pool) {
+   unique_lock<mutex> hold(pool->lock);
+   while (true) {
+      pool->wake.wait(hold, [&]() { return pool->quit || (pool->nextEngine < ATPG_PORTFOLIO_SIZE && pool->winner < 0); });
+      if (pool->quit) return;
+      int e = pool->nextEngine++;
+      pool->running++;
+      hold.unlock();
+      SearchState &S = pool->states[e];
+      int r = atpgGenerate(S.C, S, atpgPortfolio[e], pool->fault);
+      hold.lock();
+      pool->running--;
+      if (r != ATPG_ABORTED && pool->winner < 0) {
+         pool->winner = e;
+         pool->res = r;
+         if (r == ATPG_DETECTED) pool->cube = atpgTestCube(S);
+         pool->cancel = true;
       }
-      test_vectors.push_back(temp);
-      return true;
+      if (pool->running == 0 && (pool->winner >= 0 || pool->nextEngine == ATPG_PORTFOLIO_SIZE)) pool->finished.notify_all();
    }
-   else return false;
 }
 
+/** @brief Give pool a SearchState per engine on C with settings and nthreads engine threads. */
+void atpgRacePoolStart(AtpgRacePool &pool, const Circuit &C, const AtpgSettings &settings, int nthreads) {
+   pool.states.reserve(ATPG_PORTFOLIO_SIZE);
+   for (int e = 0; e < ATPG_PORTFOLIO_SIZE; e++) {
+      pool.states.emplace_back(C, settings);
+      pool.states[e].atpgCancel = &pool.cancel;
+   }
+   pool.quit = false;
+   pool.nextEngine = ATPG_PORTFOLIO_SIZE;
+   pool.running = 0;
+   pool.winner = -1;
+   for (int t = 0; t < nthreads; t++) pool.threads.push_back(thread(atpgRaceThread, &pool));
+}
 
-int dalg (char *cp) {
+void atpgRacePoolStop(AtpgRacePool &pool) {
+   {
+      lock_guard<mutex> hold(pool.lock);
+      pool.quit = true;
+   }
+   pool.wake.notify_all();
+   for (int t = 0; t < pool.threads.size(); t++) pool.threads[t].join();
+   pool.threads.clear();
+}
 
-   char faultNode_buf[MAXLINE], faultValue_buf[MAXLINE];
-   sscanf(cp, "%s %s", faultNode_buf, faultValue_buf);
+/** @brief Race the portfolio engines on fault (an id) on pool, with cooperative cancellation.
+ *
+ * The pool threads start the engines in portfolio order. An engine that aborts
+ * leaves the others running and lets the next one start; the first one to
+ * finish the fault wins and stops the rest through the pool's cancel flag.
+ * \param cube Gets the winning test.
+ * \param winner Gets the portfolio engine that won, -1 if none did.
+ * \returns ATPG_DETECTED or ATPG_UNTESTABLE from the winner, ATPG_ABORTED if all engines aborted.
+ */
+int atpgRace(AtpgRacePool &pool, int fault, vector<int> &cube, int &winner) {
+   unique_lock<mutex> hold(pool.lock);
+   pool.fault = fault;
+   pool.running = 0;
+   pool.winner = -1;
+   pool.res = ATPG_ABORTED;
+   pool.cancel = false;
+   pool.nextEngine = 0;
+   pool.wake.notify_all();
+   pool.finished.wait(hold, [&]() { return pool.running == 0 && (pool.winner >= 0 || pool.nextEngine == ATPG_PORTFOLIO_SIZE); });
+
+   winner = pool.winner;
+   if (pool.res == ATPG_DETECTED) cube = pool.cube;
+   return pool.res;
+}
 
-   int faultNode = stoi(faultNode_buf);
-   int faultValue = stoi(faultValue_buf);
-   int faultNodeIndx;
+// Work-stealing scheduler. Fault i starts on the deque of worker i % nthreads;
+// a worker takes from the front of its own deque and, when that is empty,
+// from the front of another's. A worker only posts its result under the lock;
+// one committer takes the results in fault order outside it: a fault is
+// skipped if an earlier committed pattern detects it, otherwise its outcome
+// is counted and its test cube extended by dynamic compaction (atpgCompact),
+// X-filled with atpgRandom() and added to a batch of up to BATCH_PATTERNS
+// patterns that is fault simulated in one pattern-parallel pass. Faults still
+// undetected by a pattern of the open batch are checked against it one by
+// one, so which worker ran a fault, and when, does not change the patterns:
+// they are the ones the sequential loop produces for the same atpgRandState
+// seed. Workers run ahead of
+// the commit point by up to ATPG_WINDOW faults per thread, so a hard fault
+// holds up only its own worker until the others reach the end of the window.
+#define ATPG_WINDOW 64
+#define ATPG_PENDING -1
+#define ATPG_SKIPPED 3
+
+struct atpgDeque {
+   mutex lock;
+   deque<int> faults;
+};
 
-   lev();
+/** @brief Take the next fault below limit for worker t: its own deque first, then steal.
+ * \returns the fault, or -1 if none is below limit; more is set if any deque still holds faults.
+ */
+int atpgTake(vector<atpgDeque> &queues, int t, int limit, bool &more) {
+   more = false;
+   for (int k = 0; k < queues.size(); k++) {
+      atpgDeque &q = queues[(t + k) % queues.size()];
+      lock_guard<mutex> hold(q.lock);
+      if (q.faults.empty()) continue;
+      more = true;
+      if (q.faults.front() < limit) {
+         int i = q.faults.front();
+         q.faults.pop_front();
+         return i;
+      }
+   }
+   return -1;
+}
+
+/** @brief Dynamic compaction: extend the test cube of fault f with tests for later faults.
+ *
+ * Tries up to settings.compactTries of the faults (ids) after f that are not
+ * detected yet, each by podemConstrained with the PIs of cube fixed
+ * and a budget of settings.compactBacktracks, and keeps every extension found.
+ * Only the committed state (faultStatus and the committed patterns still
+ * in pending) is read, never the results of
+ * searches still running ahead of the commit point, so the outcome does not
+ * depend on which results are in. Stops early once cube has no X left.
+ */
+void atpgCompact(SearchState &S, vector<int> &cube, int f, const vector<int> &faults, PatternBatch &pending) {
+   S.atpgBacktrackCap = S.settings.compactBacktracks;
+   int tries = 0;
+   for (int j = f + 1; j < faults.size() && tries < S.settings.compactTries; j++) {
+      if (batchDetected(pending, faults[j])) continue;
+      if (find(cube.begin(), cube.end(), LOGIC_X) == cube.end()) break;
+      tries++;
+      if (podemConstrained(S, &S.C.node[FAULT_NODE(faults[j])], FAULT_STUCK(faults[j]), cube) == ATPG_DETECTED) cube = atpgTestCube(S);
+   }
+   S.atpgBacktrackCap = -1;
+}
+
+// ATPG result cache (CACHE command). One line per fault with its outcome, the
+// engine, limits and learning depth that produced it and, for a test, the
+// specified PIs of the cube. An entry is only reused while the cone hash of the fault site is the
+// one it was made with: a test for a fault depends on nothing but the fanin of
+// the outputs the site reaches, so a change anywhere else keeps it valid.
+struct AtpgCacheEntry {
+   unsigned long long cone;        // coneHash of the fault site
+   int result;                     // ATPG_DETECTED, ATPG_UNTESTABLE or ATPG_ABORTED
+   string engine;
+   int backtracks;                 // backtrack limit of the search
+   double seconds;                 // time limit of the search (0 = none)
+   int depth;                      // DALG learning depth of the search
+   vector<pair<int, int> > cube;   // (PI number, value) of the specified PIs of a test
+};
+
+string atpgCacheFile;                    // empty if the cache is off
+map<int, AtpgCacheEntry> atpgCache;      // by fault id
+vector<unsigned long long> coneHash;     // per node index
+vector<int> atpgCachePi;                 // Pinput position per node index, -1 if not a PI
+unsigned long long circuitHash;
+atomic<int> atpgCacheHits(0);
+const char *atpgResultName[] = {"DETECTED", "UNTESTABLE", "ABORTED"};
+
+unsigned long long hashMix(unsigned long long h) {
+   h += 0x9e3779b97f4a7c15ULL;
+   h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+   h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+   return h ^ (h >> 31);
+}
+
+/** @brief Fanin hashes of the nodes along order (from lev), and circuitHash.
+ *
+ * The fanin hash of a node covers its number, type and, in input order, the
+ * fanin hashes of its inputs; circuitHash sums those of all the outputs.
+ */
+void atpgFaninHash(const vector<int> &order, vector<unsigned long long> &fanin) {
+   fanin.assign(Nnodes, 0);
+   for (int k = 0; k < order.size(); k++) {
+      NSTRUC *np = &Node[order[k]];
+      unsigned long long h = hashMix((unsigned long long) np->num * 8 + np->type);
+      for (int j = 0; j < np->fin; j++) h = hashMix(h ^ fanin[np->unodes[j]->indx]);
+      fanin[np->indx] = h;
+   }
+   circuitHash = Nnodes;
+   for (int i = 0; i < Npo; i++) circuitHash += fanin[Poutput[i]->indx];
+   circuitHash = hashMix(circuitHash);
+}
+
+/** @brief Cone hash of every node along order: the sum of the fanin hashes of
+ * the primary outputs it reaches.
+ */
+void atpgConeHash(const vector<int> &order) {
+   vector<unsigned long long> fanin;
+   atpgFaninHash(order, fanin);
+
+   int words = (Npo + 63) / 64;
+   vector<unsigned long long> reach((size_t) Nnodes * words, 0);
+   for (int i = 0; i < Npo; i++) reach[(size_t) Poutput[i]->indx * words + i / 64] |= 1ULL << (i % 64);
+   coneHash.assign(Nnodes, 0);
+   for (int k = order.size() - 1; k >= 0; k--) {
+      NSTRUC *np = &Node[order[k]];
+      unsigned long long *r = &reach[(size_t) np->indx * words];
+      for (int j = 0; j < np->fout; j++) {
+         unsigned long long *d = &reach[(size_t) np->dnodes[j]->indx * words];
+         for (int w = 0; w < words; w++) r[w] |= d[w];
+      }
+      for (int i = 0; i < Npo; i++) {
+         if (r[i / 64] & (1ULL << (i % 64))) coneHash[np->indx] += fanin[Poutput[i]->indx];
+      }
+   }
 
-   for (int i = 0; i < Nnodes; i++) {
-      if (Node[i].num == faultNode) {
-         faultNodeIndx = Node[i].indx;
+   atpgCachePi.assign(Nnodes, -1);
+   for (int i = 0; i < Npi; i++) atpgCachePi[Pinput[i]->indx] = i;
+}
+
+/** @brief Read atpgCacheFile for the current circuit (nothing if the cache is off).
+ * Entries of faults the circuit does not have are dropped.
+ */
+void atpgCacheLoad(const vector<int> &order) {
+   atpgCache.clear();
+   atpgCacheHits = 0;
+   if (atpgCacheFile.empty()) return;
+   atpgConeHash(order);
+
+   ifstream cache_file(atpgCacheFile);
+   if (!cache_file.is_open()) {
+      cout << "Cache: new file " << atpgCacheFile << endl;
+      return;
+   }
+   string line, fields[9];
+   unsigned long long hash = 0;
+   int total = 0, valid = 0;
+   while (getline(cache_file, line)) {
+      if (line.empty()) continue;
+      if (line[0] == '#') {
+         sscanf(line.c_str(), "# %*s %llx", &hash);
+         continue;
       }
+      stringstream X(line);
+      int nf = 0;
+      while (nf < 8 && X >> fields[nf]) nf++;
+      int num, stuck;
+      if (nf < 8 || sscanf(fields[0].c_str(), "%d@%d", &num, &stuck) != 2) continue;
+      if (num < 0 || num >= indxOfNum.size() || indxOfNum[num] < 0) continue;
+      AtpgCacheEntry e;
+      e.cone = stoull(fields[1], NULL, 16);
+      e.result = find(atpgResultName, atpgResultName + 3, fields[2]) - atpgResultName;
+      if (e.result == 3) continue;
+      e.engine = fields[3];
+      e.backtracks = stoi(fields[4]);
+      e.seconds = stod(fields[5]);
+      e.depth = stoi(fields[6]);
+      stringstream C(fields[7]);
+      string pin;
+      int pnum, pval;
+      while (getline(C, pin, ',')) {
+         if (sscanf(pin.c_str(), "%d=%d", &pnum, &pval) == 2) e.cube.push_back(make_pair(pnum, pval));
+      }
+      int id = FAULT_ID(indxOfNum[num], stuck & 1);
+      total++;
+      valid += (e.cone == coneHash[FAULT_NODE(id)]);
+      atpgCache[id] = e;
    }
+   cout << "Cache: " << valid << " of " << total << " entries valid (circuit " << (hash == circuitHash ? "unchanged" : "changed") << ")" << endl;
+}
 
-   DalgCall(make_pair(faultNodeIndx, faultValue));
+/** @brief Write atpgCache to atpgCacheFile, leaving out entries whose cone changed. */
+void atpgCacheSave() {
+   if (atpgCacheFile.empty()) return;
+   ofstream cache_file(atpgCacheFile);
+   if (!cache_file) {
+      cout << "Couldn't create file\n";
+      return;
+   }
+   cache_file << "# " << circuitName << " " << hex << circuitHash << dec << endl;
+   for (auto const &it : atpgCache) {
+      const AtpgCacheEntry &e = it.second;
+      if (e.cone != coneHash[FAULT_NODE(it.first)]) continue;
+      cache_file << Node[FAULT_NODE(it.first)].num << "@" << FAULT_STUCK(it.first) << " " << hex << e.cone << dec << " "
+                 << atpgResultName[e.result] << " " << e.engine << " " << e.backtracks << " " << e.seconds << " " << e.depth << " ";
+      for (int j = 0; j < e.cube.size(); j++) cache_file << (j ? "," : "") << e.cube[j].first << "=" << e.cube[j].second;
+      cache_file << (e.cube.empty() ? "-" : "") << endl;
+   }
+}
 
-   int initial;
-   if (test_vectors.size() != 0) {
-      string output_file = circuitName + "_DALG_" + faultNode_buf + "@" + faultValue_buf + ".txt";
-      ofstream output_test_pattern_file;
-      output_test_pattern_file.open(output_file);
-      if ( output_test_pattern_file ) {
-         initial = 0;
-         for(int i=0;i<Npi  ;i++){
-            if (initial == 1) {
-               output_test_pattern_file << ",";
+/** @brief Cached outcome of fault id under the limits of settings.
+ * \returns false if there is no usable entry. A test or an untestable proof
+ * holds for any engine; an abort only for the same engine and no larger limits
+ * or learning depth.
+ * For a test, cube gets the cached cube in Pinput order.
+ */
+bool atpgCacheLookup(int id, const string &alg, const AtpgSettings &settings, int &res, vector<int> &cube) {
+   auto it = atpgCache.find(id);
+   if (it == atpgCache.end() || it->second.cone != coneHash[FAULT_NODE(id)]) return false;
+   const AtpgCacheEntry &e = it->second;
+   if (e.result == ATPG_ABORTED) {
+      if (e.engine != alg || settings.backtracks > e.backtracks) return false;
+      if (e.seconds > 0 && (settings.seconds == 0 || settings.seconds > e.seconds)) return false;
+      if (settings.depth > e.depth) return false;
+   }
+   if (e.result == ATPG_DETECTED) {
+      cube.assign(Npi, LOGIC_X);
+      for (int j = 0; j < e.cube.size(); j++) {
+         int num = e.cube[j].first;
+         if (num < 0 || num >= indxOfNum.size() || indxOfNum[num] < 0 || atpgCachePi[indxOfNum[num]] < 0) return false;
+         cube[atpgCachePi[indxOfNum[num]]] = e.cube[j].second;
+      }
+   }
+   res = e.result;
+   atpgCacheHits++;
+   return true;
+}
+
+/** @brief Cache entry for fault id from a search with alg and settings (cube in Pinput order for a test). */
+AtpgCacheEntry atpgCacheEntry(int id, int res, const string &alg, const AtpgSettings &settings, const vector<int> &cube) {
+   AtpgCacheEntry e;
+   e.cone = coneHash[FAULT_NODE(id)];
+   e.result = res;
+   e.engine = alg;
+   e.backtracks = settings.backtracks;
+   e.seconds = settings.seconds;
+   e.depth = settings.depth;
+   for (int j = 0; j < cube.size(); j++) {
+      if (cube[j] != LOGIC_X) e.cube.push_back(make_pair(Pinput[j]->num, cube[j]));
+   }
+   return e;
+}
+
+int cache(char *cp) {
+   char file_buf[MAXLINE];
+   if (sscanf(cp, "%s", file_buf) != 1) {
+      cout << "Cache: " << (atpgCacheFile.empty() ? "OFF" : atpgCacheFile) << endl;
+      return 0;
+   }
+   string file = file_buf;
+   atpgCacheFile = (file == "OFF" || file == "off") ? "" : file;
+   cout << "OK" << endl;
+   return 0;
+}
+
+unsigned long long atpgRandState = 1;     // random patterns and X fill of ATPG_DET/ATPG
+function<void(int)> atpgCommitHook;       // called by the committer with the new frontier, once its patterns are simulated
+function<bool()> atpgCommitDue;           // asked by the committer whether to simulate its patterns early for the hook
+
+/** @brief Next random bit of the ATPG generator (splitmix64, so its state can be checkpointed). */
+int atpgRandom() {
+   return hashMix(atpgRandState++) & 1;
+}
+
+/** @brief Generate tests for faults (ids) on nthreads threads, with fault dropping.
+ *
+ * nthreads worker threads search, each on a SearchState of its own with the
+ * limits in settings; the calling thread commits. Committed patterns are
+ * appended to patterns and simulated along order, BATCH_PATTERNS at a time,
+ * against the active fault list; the outcome of every
+ * committed fault ends up in faultStatus.
+ * For PORTFOLIO every worker also gets a race pool with one SearchState per
+ * engine and max(1, min(cores / nthreads, engines)) engine threads, and
+ * wins[e] counts the committed faults that engine e finished first (added to
+ * the counts already in wins).
+ * With the cache on, a fault with a usable entry takes its outcome from there
+ * instead of a search, and every search that finishes is added to atpgCache.
+ */
+void atpgSchedule(const string &alg, const AtpgSettings &settings, const vector<int> &faults, const vector<int> &order, vector<int> &active, vector<vector<int> > &patterns, vector<int> &wins, int nthreads) {
+   int n = faults.size();
+   vector<SearchState> states;
+   states.reserve(nthreads);
+   for (int t = 0; t < nthreads; t++) states.emplace_back(circuit, settings);
+   vector<AtpgRacePool> race(alg == "PORTFOLIO" ? nthreads : 0);
+   int engineThreads = min(max((int) thread::hardware_concurrency() / nthreads, 1), ATPG_PORTFOLIO_SIZE);
+   for (int t = 0; t < race.size(); t++) atpgRacePoolStart(race[t], circuit, settings, engineThreads);
+   wins.resize(ATPG_PORTFOLIO_SIZE, 0);
+   vector<atpgDeque> queues(nthreads);
+   for (int i = 0; i < n; i++) queues[i % nthreads].faults.push_back(i);
+
+   // posted by the workers under commitLock; a result stays put once posted
+   vector<int> result(n, ATPG_PENDING), winner(n, -1);
+   vector<char> cached(n, 0);
+   vector<vector<int> > cubes(n);
+   vector<char> done(n, 0);     // the fault is known to be detected, so workers skip it
+   vector<int> slot(2 * Nnodes, -1);
+   for (int i = 0; i < n; i++) slot[faults[i]] = i;
+   vector<pair<int, AtpgCacheEntry> > fresh;     // new cache entries, merged at the end
+   mutex commitLock;
+   condition_variable advanced, posted;
+   atomic<int> frontier(0);     // faults before it are committed
+
+   auto worker = [&](int t) {
+      SearchState &S = states[t];
+      while (true) {
+         int seen = frontier;
+         bool more;
+         int i = atpgTake(queues, t, seen + ATPG_WINDOW * nthreads, more);
+         if (i < 0) {
+            if (!more) break;
+            unique_lock<mutex> hold(commitLock);
+            advanced.wait(hold, [&]() { return frontier != seen; });
+            continue;
+         }
+         bool skip;
+         {
+            lock_guard<mutex> hold(commitLock);
+            skip = done[i];
+         }
+         int res = ATPG_SKIPPED;
+         vector<int> cube;
+         int won = -1;
+         bool hit = !skip && atpgCacheLookup(faults[i], alg, settings, res, cube);
+         if (!skip && !hit) {
+            if (!race.empty()) res = atpgRace(race[t], faults[i], cube, won);
+            else {
+               res = atpgGenerate(circuit, S, alg, faults[i]);
+               if (res == ATPG_DETECTED) cube = atpgTestCube(S);
             }
-            initial = 1;
-            output_test_pattern_file << Pinput[i]->num;
          }
-         output_test_pattern_file << endl;
-         initial = 0;
-
-         for (int j=0; j<test_vectors.size(); j++){
-            vector<int> tmp = test_vectors[j];
-            initial = 0;
-            for(int m=0;m< tmp.size(); m++){
-               if (initial == 1) {
-                        output_test_pattern_file << ",";
+         {
+            lock_guard<mutex> hold(commitLock);
+            result[i] = res;
+            cached[i] = hit;
+            winner[i] = won;
+            cubes[i].swap(cube);
+         }
+         posted.notify_one();
+      }
+   };
+   vector<thread> workers;
+   for (int t = 0; t < nthreads; t++) workers.push_back(thread(worker, t));
+
+   // the calling thread commits: it takes the run of posted results at the
+   // frontier and commits them outside the lock, collecting the new patterns
+   // in a batch that is simulated once it is full
+   SearchState S(circuit, settings);
+   PatternBatch batch;
+   batchInit(batch, order);
+   int f = 0;
+   while (f < n) {
+      int last;
+      {
+         unique_lock<mutex> hold(commitLock);
+         posted.wait(hold, [&]() { return result[f] != ATPG_PENDING; });
+         for (last = f; last < n && result[last] != ATPG_PENDING; last++);
+      }
+      for (; f < last; f++) {
+         if (!atpgCacheFile.empty() && !cached[f] && result[f] != ATPG_SKIPPED) {
+            fresh.push_back(make_pair(faults[f], atpgCacheEntry(faults[f], result[f], winner[f] >= 0 ? atpgPortfolio[winner[f]] : alg, settings, cubes[f])));
+         }
+         if (!batchDetected(batch, faults[f])) {
+            if (winner[f] >= 0) wins[winner[f]]++;
+            if (result[f] == ATPG_UNTESTABLE) faultStatus[faults[f]] = FAULT_UNTESTABLE;
+            else if (result[f] == ATPG_ABORTED) faultStatus[faults[f]] = FAULT_ABORTED;
+            else if (result[f] == ATPG_DETECTED) {
+               vector<int> &cube = cubes[f];
+               atpgCompact(S, cube, f, faults, batch);
+               for (int j = 0; j < Npi; j++) {
+                  if (cube[j] == LOGIC_X) cube[j] = atpgRandom();
                }
-               initial = 1;
-               if (tmp[m] == LOGIC_X) {
-                  output_test_pattern_file << "X";
-               } else {
-                  output_test_pattern_file << tmp[m];
+               patterns.push_back(cube);
+               batchAdd(batch, cube);
+               if (batch.count == BATCH_PATTERNS) {
+                  batchFlush(batch, active);
+                  if (atpgCommitHook) atpgCommitHook(f + 1);
                }
             }
-            output_test_pattern_file << endl;
-         } 
+         }
+         vector<int>().swap(cubes[f]);
       }
-      output_test_pattern_file.close();
-      return 0;
-   } else {
-      return 1;
+      if (atpgCommitHook && atpgCommitDue()) {
+         batchFlush(batch, active);
+         atpgCommitHook(f);
+      }
+      {
+         lock_guard<mutex> hold(commitLock);
+         frontier = f;
+         for (int k = 0; k < batch.dropped.size(); k++) {
+            if (slot[batch.dropped[k]] >= 0) done[slot[batch.dropped[k]]] = 1;
+         }
+      }
+      batch.dropped.clear();
+      advanced.notify_all();
    }
+   batchFlush(batch, active);
+   for (int t = 0; t < workers.size(); t++) workers[t].join();
+   for (int t = 0; t < race.size(); t++) atpgRacePoolStop(race[t]);
+   for (int k = 0; k < fresh.size(); k++) atpgCache[fresh[k].first] = fresh[k].second;
 }
 
 
-
 int atpg_det(char *cp) {
    // time
    // read
@@ -2760,8 +5262,21 @@ int atpg_det(char *cp) {
    const auto before = std::chrono::system_clock::now();
    //clock_t tStart = clock();
 
-   char circuit_name[MAXLINE], alg_name[MAXLINE];
-   sscanf(cp, "%s %s", circuit_name, alg_name);
+   char circuit_name[MAXLINE], alg_name[MAXLINE], backtrack_buf[MAXLINE], time_buf[MAXLINE], depth_buf[MAXLINE], threads_buf[MAXLINE], seed_buf[MAXLINE], compact_buf[MAXLINE];
+   int nargs = sscanf(cp, "%s %s %s %s %s %s %s %s", circuit_name, alg_name, backtrack_buf, time_buf, depth_buf, threads_buf, seed_buf, compact_buf);
+   // optional search limits per fault, the DALG recursive learning depth, the
+   // number of threads generating tests (0 = all cores), the seed of the X fill,
+   // and the secondary faults tried per pattern by dynamic compaction (0 = off)
+   AtpgSettings settings;
+   int nthreads = 1;
+   unsigned seed = 1;
+   if (nargs >= 3) settings.backtracks = stoi(backtrack_buf);
+   if (nargs >= 4) settings.seconds = stod(time_buf);
+   if (nargs >= 5) settings.depth = stoi(depth_buf);
+   if (nargs >= 6) nthreads = stoi(threads_buf);
+   if (nargs >= 7) seed = stoul(seed_buf);
+   if (nargs >= 8) settings.compactTries = stoi(compact_buf);
+   if (nthreads <= 0) nthreads = max((int) thread::hardware_concurrency(), 1);
    
    string alg_name_str = alg_name;
    transform(alg_name_str.begin(), alg_name_str.end(), alg_name_str.begin(), ::toupper);
@@ -2773,35 +5288,9 @@ int atpg_det(char *cp) {
    string rfl_arguments = "atpg_det_rfl.out";
    rfl(strdup(rfl_arguments.c_str()));
 
-   string token;
-   int i;
    // read fault list
-   vector<pair<int,int> > fault_list;
-   fault_list.clear();
-   pair<int,int> fault;
-   ifstream fault_file;
-   fault_file.open(rfl_arguments);
-   string fault_line;
-   if ( fault_file.is_open() ) {
-      while ( fault_file ) {
-         getline (fault_file, fault_line);   // read line from fault list file
-         stringstream X(fault_line);
-         i = 0;
-         while (getline(X, token, '@')) {
-            if (i == 0 ) {
-               fault.first = (stoi(token));
-               i = 1;
-            } else {
-               fault.second = stoi(token);
-            }
-         }
-         if (fault_line != "") {
-            fault_list.push_back(fault);
-         }
-      }
-      fault_file.close();
-   }
-   else {
+   vector<int> fault_list;
+   if (!readFaultList(rfl_arguments.c_str(), fault_list)) {
       cout << "Couldn't open file\n";
       return 1;
    }
@@ -2818,57 +5307,36 @@ int atpg_det(char *cp) {
 
    int node_num = 1;
    string alg;
-   string in_pattern_buf = circuitName + "_DALG_" + to_string(fault_list[i].first) + "@" + to_string(fault_list[i].second) + ".txt";
-
-   for (int i=0; i<fault_list.size(); i++) {
-      if (alg_name_str == "DALG") {
-         string dalg_arguments = to_string(fault_list[i].first) + " " + to_string(fault_list[i].second);
-         int x = dalg(strdup(dalg_arguments.c_str()));
-         alg = "DALG";
-         if (x == 0) {
-            // read test patterns
-            vector<int> temp; 
-            temp.clear();
-            for(int i=0;i<Npi  ;i++){
-               if(Pinput[i]->value==LOGIC_D) {
-                  temp.push_back(1);
-               } else if(Pinput[i]->value==LOGIC_DBAR) {
-                  temp.push_back(0);
-               } else if (Pinput[i]->value==LOGIC_X) {
-                  temp.push_back(rand()%2);
-               } else {
-                  temp.push_back(Pinput[i]->value);
-               }
-            }
-            test_patterns.push_back(temp);
-         }
-      } else if (alg_name_str == "PODEM") {
-         string podem_arguments = to_string(fault_list[i].first) + " " + to_string(fault_list[i].second);
-         int x = podem(strdup(podem_arguments.c_str()));
-         alg = "PODEM";
-         if (x == 0) {  // if not timeout
-            for (int j = 0; j < Nnodes; j++) {
-
-               if (Node[j].fin == 0) {
-                  if (Node[j].value == LOGIC_X) {
-                     Node[j].value = rand()%2;
-                  } else if (Node[j].value == LOGIC_D) {
-                     Node[j].value = LOGIC_1;
-                  } else if (Node[j].value == LOGIC_DBAR) {
-                     Node[j].value = LOGIC_0;
-                  }
-                  test_pattern.push_back(Node[j].value);
-               }
-            }
-            test_patterns.push_back(test_pattern);
-            test_pattern.clear();
-         }
-      } else {
-         cout << "invalid argument" << endl;
-         return 1;
-      }
 
+   // every new pattern is fault simulated against the remaining faults, and
+   // the faults it detects are dropped from the list
+   lev();
+   vector<int> sim_order = node_queue;
+   node_queue.clear();
+   vector<int> targets = collapseFaults(fault_list);     // one fault per collapsed class
+   vector<int> active(targets);
+
+   if (!atpgEngineKnown(alg_name_str)) {
+      cout << "invalid argument" << endl;
+      return 1;
    }
+   alg = alg_name_str;
+   atpgRandState = seed;
+   vector<int> wins;
+   atpgCacheLoad(sim_order);
+   atpgSchedule(alg, settings, targets, sim_order, active, test_patterns, wins, nthreads);
+
+   // a fault whose dominated representative got no test needs its own, unless
+   // a pattern already detects it; the new patterns can still detect
+   // representatives that were aborted
+   vector<int> rest = expandFaultStatus(fault_list);
+   active = rest;
+   for (int k = 1; k < test_patterns.size() && !active.empty(); k++) pfsPattern(sim_order, test_patterns[k], active);
+   rest = active;
+   active.insert(active.end(), targets.begin(), targets.end());
+   atpgSchedule(alg, settings, rest, sim_order, active, test_patterns, wins, nthreads);
+   expandFaultStatus(fault_list);
+   atpgCacheSave();
 
    // write patterns to output file
    bool first = true;
@@ -2892,34 +5360,13 @@ int atpg_det(char *cp) {
       return 1;
    }
 
-   // fault coverage calculation
-   set<pair<int,int> > detected_faults;
-
-   string pfs_arguments = atpg_det_output_patterns + " " + rfl_arguments + " " + "detected_faults_temp.txt";
-   pfs(strdup(pfs_arguments.c_str()));
-
-   // read fault list
-   fault_file.open("detected_faults_temp.txt");
-   if ( fault_file.is_open() ) {
-      while ( fault_file ) {
-         getline (fault_file, fault_line);   // read line from fault list file
-         stringstream X(fault_line);
-         i = 0;
-         while (getline(X, token, '@')) {
-            if (i == 0 ) {
-               fault.first = (stoi(token));
-               i = 1;
-            } else {
-               fault.second = stoi(token);
-            }
-         }
-         if (fault_line != "") {
-            detected_faults.insert(fault);
-         }
-      }
-      fault_file.close();
-   } else {
-      cout << "Couldn't open file\n";
+   // fault coverage from the simulation of the patterns
+   int num_covered = 0, num_untestable = 0, num_aborted = 0;
+   for (int i = 0; i < fault_list.size(); i++) {
+      int st = faultStatus[fault_list[i]];
+      num_covered += (st == FAULT_DETECTED);
+      num_untestable += (st == FAULT_UNTESTABLE);
+      num_aborted += (st == FAULT_ABORTED);
    }
 
    const sec duration = std::chrono::system_clock::now() - before;
@@ -2929,7 +5376,21 @@ int atpg_det(char *cp) {
    if ( output_report ) {
       output_report << "Algorithm: " << alg << endl;
       output_report << "Circuit: " << circuitName << endl;
-      output_report << "Fault Coverage: " << fixed << setprecision(2) << detected_faults.size()*100.0/fault_list.size() << "%" << endl;
+      output_report << "Fault Coverage: " << fixed << setprecision(2) << num_covered*100.0/fault_list.size() << "%" << endl;
+      output_report << "Detected: " << num_covered << endl;
+      output_report << "Untestable: " << num_untestable << endl;
+      output_report << "Aborted: " << num_aborted << endl;
+      output_report << "Faults: " << fault_list.size() << " (" << targets.size() << " targeted after collapsing)" << endl;
+      output_report << "Patterns: " << test_patterns.size() - 1 << endl;
+      output_report << "Backtrack limit: " << settings.backtracks << endl;
+      if (alg == "DALG") output_report << "Learning depth: " << settings.depth << endl;
+      output_report << "Threads: " << nthreads << endl;
+      output_report << "Seed: " << seed << endl;
+      output_report << "Compaction tries: " << settings.compactTries << endl;
+      if (!atpgCacheFile.empty()) output_report << "Cache hits: " << atpgCacheHits << endl;
+      if (alg == "PORTFOLIO") {
+         for (int e = 0; e < ATPG_PORTFOLIO_SIZE; e++) output_report << "Wins " << atpgPortfolio[e] << ": " << wins[e] << endl;
+      }
       output_report << "Time: " << duration.count() << " seconds" << endl;
       output_report.close();
    } else {
@@ -2944,47 +5405,170 @@ int atpg_det(char *cp) {
 }
 
 
-int atpg(char *cp) {
-   // time
-   // read
-   // lev
-   // rfl
-   // random test generation
-   // calculate fc after every Nnodes/10 patterns
-   // if difference in fc is less than 10%
-   // -- switch to podem
-      // for all faults
-      // --podem/dalg
-      // --add pattern
-   // print patterns
-   // logic for fc
-   // report
+// Checkpoint of an ATPG run, in binary. It is written at most every
+// interval seconds, at the end of a random batch or when the commit frontier
+// of the scheduler advances, so the fault statuses, the patterns and the
+// generator state in it belong together; RESUME carries on from there and
+// ends with the patterns the uninterrupted run writes.
+#define ATPG_CHECKPOINT_MAGIC "ATPGCKP1"
+#define ATPG_PHASE_RANDOM 0
+#define ATPG_PHASE_TARGETS 1   // representatives the random patterns left
+#define ATPG_PHASE_REST 2      // faults that only dominate a representative without a test
+
+struct AtpgCheckpoint {
+   string circuit, alg;
+   int backtracks, nthreads, compactTries;
+   double seconds;
+   double interval;               // seconds between checkpoints (0 = none)
+   unsigned seed;
+   unsigned long long hash;       // circuitHash
+   unsigned long long rng;        // atpgRandState
+   int phase, fc, fcOld;
+   vector<int> faults;            // fault ids the current deterministic phase schedules
+   int next;                      // faults[0 .. next) are committed
+   vector<unsigned char> status;  // faultStatus
+   vector<vector<int> > patterns; // all patterns so far, Pinput order
+   vector<int> wins;
+   double elapsed;                // seconds spent up to the checkpoint
+};
+
+template <class T> void ckptPut(ostream &out, const T &v) { out.write((const char *) &v, sizeof(T)); }
+template <class T> void ckptGet(istream &in, T &v) { in.read((char *) &v, sizeof(T)); }
+
+template <class T> void ckptPutVec(ostream &out, const vector<T> &v) {
+   int n = v.size();
+   ckptPut(out, n);
+   out.write((const char *) v.data(), n * sizeof(T));
+}
+
+template <class T> void ckptGetVec(istream &in, vector<T> &v) {
+   int n = -1;
+   ckptGet(in, n);
+   if (!in || n < 0) {
+      in.setstate(ios::failbit);
+      return;
+   }
+   v.resize(n);
+   in.read((char *) v.data(), n * sizeof(T));
+}
+
+void ckptPutStr(ostream &out, const string &s) { ckptPutVec(out, vector<char>(s.begin(), s.end())); }
+
+void ckptGetStr(istream &in, string &s) {
+   vector<char> v;
+   ckptGetVec(in, v);
+   s.assign(v.begin(), v.end());
+}
+
+/** @brief Write c to file, through a temporary so that a run killed while
+ * writing leaves the previous checkpoint intact. The patterns take one bit per PI.
+ */
+bool atpgCheckpointSave(const string &file, const AtpgCheckpoint &c) {
+   string tmp = file + ".tmp";
+   ofstream out(tmp, ios::binary);
+   if (!out) return false;
+   out.write(ATPG_CHECKPOINT_MAGIC, 8);
+   ckptPutStr(out, c.circuit);
+   ckptPutStr(out, c.alg);
+   ckptPut(out, c.backtracks);
+   ckptPut(out, c.nthreads);
+   ckptPut(out, c.compactTries);
+   ckptPut(out, c.seconds);
+   ckptPut(out, c.interval);
+   ckptPut(out, c.seed);
+   ckptPut(out, c.hash);
+   ckptPut(out, c.rng);
+   ckptPut(out, c.phase);
+   ckptPut(out, c.fc);
+   ckptPut(out, c.fcOld);
+   ckptPutVec(out, c.faults);
+   ckptPut(out, c.next);
+   ckptPutVec(out, c.status);
+   int npat = c.patterns.size(), width = npat ? c.patterns[0].size() : 0;
+   vector<unsigned char> bits(((size_t) npat * width + 7) / 8, 0);
+   for (size_t k = 0; k < (size_t) npat * width; k++) {
+      if (c.patterns[k / width][k % width]) bits[k / 8] |= 1 << (k % 8);
+   }
+   ckptPut(out, npat);
+   ckptPut(out, width);
+   ckptPutVec(out, bits);
+   ckptPutVec(out, c.wins);
+   ckptPut(out, c.elapsed);
+   out.close();
+   if (!out) return false;
+   return rename(tmp.c_str(), file.c_str()) == 0;
+}
+
+/** @brief Read a checkpoint written by atpgCheckpointSave; false if file is not one. */
+bool atpgCheckpointLoad(const string &file, AtpgCheckpoint &c) {
+   ifstream in(file, ios::binary);
+   char magic[8];
+   if (!in.read(magic, 8) || memcmp(magic, ATPG_CHECKPOINT_MAGIC, 8)) return false;
+   ckptGetStr(in, c.circuit);
+   ckptGetStr(in, c.alg);
+   ckptGet(in, c.backtracks);
+   ckptGet(in, c.nthreads);
+   ckptGet(in, c.compactTries);
+   ckptGet(in, c.seconds);
+   ckptGet(in, c.interval);
+   ckptGet(in, c.seed);
+   ckptGet(in, c.hash);
+   ckptGet(in, c.rng);
+   ckptGet(in, c.phase);
+   ckptGet(in, c.fc);
+   ckptGet(in, c.fcOld);
+   ckptGetVec(in, c.faults);
+   ckptGet(in, c.next);
+   ckptGetVec(in, c.status);
+   int npat = 0, width = 0;
+   vector<unsigned char> bits;
+   ckptGet(in, npat);
+   ckptGet(in, width);
+   ckptGetVec(in, bits);
+   if (!in || npat < 0 || width < 0 || bits.size() != ((size_t) npat * width + 7) / 8) return false;
+   c.patterns.assign(npat, vector<int>(width));
+   for (size_t k = 0; k < (size_t) npat * width; k++) c.patterns[k / width][k % width] = (bits[k / 8] >> (k % 8)) & 1;
+   ckptGetVec(in, c.wins);
+   ckptGet(in, c.elapsed);
+   return (bool) in && c.next >= 0 && c.next <= c.faults.size();
+}
 
+/** @brief The ATPG flow: random patterns until the coverage of the collapsed
+ * faults stops growing, then deterministic test generation for the faults left.
+ * \param job Settings of the run; for a resumed run also the state to continue from.
+ * \param ckpt_file Checkpoint file, empty for circuitName_ATPG_checkpoint.bin.
+ * \param resumed True if job comes from a checkpoint.
+ *
+ * The checkpoint file is removed once the run completes.
+ */
+int atpgRun(AtpgCheckpoint &job, string ckpt_file, bool resumed) {
    // start clock
    const auto before = std::chrono::system_clock::now();
+   auto last_save = before;
+   double prior = resumed ? job.elapsed : 0;
+
+   AtpgSettings settings;
+   settings.backtracks = job.backtracks;
+   settings.seconds = job.seconds;
+   settings.compactTries = job.compactTries;
+   string alg = job.alg;
+   int nthreads = job.nthreads;
 
-   char circuit_name[MAXLINE], alg_name[MAXLINE];
-   sscanf(cp, "%s %s", circuit_name, alg_name);
-   
    // read circuit
-   cread((circuit_name));
+   char circuit_name[MAXLINE];
+   snprintf(circuit_name, MAXLINE, "%s", job.circuit.c_str());
+   cread(circuit_name);
+   if (ckpt_file.empty()) ckpt_file = circuitName + "_ATPG_checkpoint.bin";
 
+   // every pattern is fault simulated against the faults not detected yet
    lev();
-   
-   // random test generation
-   vector<pair<int, int> > fault_list;     // dictionary to hold PO values
-   fault_list.clear();
-   vector<pair<int,int> > fault_list_drop;
-   fault_list_drop.clear();
-   pair<int,int> fault;    // temporarily holds the faults
+   vector<int> sim_order = node_queue;
+   node_queue.clear();
+   vector<unsigned long long> fanin;
+   atpgFaninHash(sim_order, fanin);
 
+   vector<int> fault_list;     // fault ids of all the nodes
    vector<int> PI;
-   PI.clear();
-   vector<int> input_values;
-   input_values.clear();
-   vector<vector<int> > test_patterns;
-   test_patterns.clear();
-
    NSTRUC *np;
 
    // get all faults
@@ -2997,256 +5581,142 @@ int atpg(char *cp) {
       }
 
       // add faults
-      fault.first = np->num;
       for (int j = 0; j < 2; j++) {     // assign value of 0 and 1 to the faulty node
-         fault.second = j; 
-         fault_list.push_back(fault);     // add the fault to the fault_list
-         fault_list_drop.push_back(fault);   // add fault to the fault list after dropping - we will use this later
+         fault_list.push_back(FAULT_ID(i, j));     // add the fault to the fault_list
       }
    }
+   vector<int> collapsed = collapseFaults(fault_list);     // one fault per collapsed class
 
-   string test_pattern_buf = circuitName + "_ATPG_patterns.txt";
-
-   ofstream output_test_pattern_file;
-   output_test_pattern_file.open(test_pattern_buf);
-   // print test patterns to a file
-   int flag = 0;
-   if ( output_test_pattern_file ) {
-      for (int i = 0; i < PI.size(); i++) {
-         if (flag == 0) {
-            output_test_pattern_file << PI[i];
-            flag = 1;
-         } else {
-            output_test_pattern_file << "," << PI[i];
-         }
+   if (resumed) {
+      if (job.hash != circuitHash || job.status.size() != faultStatus.size()) {
+         cout << "Checkpoint does not match the circuit\n";
+         return 1;
       }
-      flag = 0;
-      output_test_pattern_file << endl;
+      faultStatus = job.status;
+      cout << "Resuming with " << job.patterns.size() << " patterns" << endl;
    } else {
-      cout << "Couldn't create file\n";
+      job.hash = circuitHash;
+      job.rng = job.seed;
+      job.phase = ATPG_PHASE_RANDOM;
+      job.fc = job.fcOld = 0;
+      job.faults.clear();
+      job.next = 0;
+      job.patterns.clear();
+      job.wins.clear();
    }
+   atpgRandState = job.rng;
+
+   // is the interval over?
+   auto due = [&]() {
+      const sec since = std::chrono::system_clock::now() - last_save;
+      return job.interval > 0 && since.count() >= job.interval;
+   };
+   // checkpoint if the interval is over; the caller holds the state steady
+   auto checkpoint = [&]() {
+      if (!due()) return;
+      const auto now = std::chrono::system_clock::now();
+      const sec spent = now - before;
+      job.rng = atpgRandState;
+      job.status = faultStatus;
+      job.elapsed = prior + spent.count();
+      if (!atpgCheckpointSave(ckpt_file, job)) cout << "Couldn't create file\n";
+      last_save = now;
+   };
 
-   set<pair<int,int> > detected_faults;
-   int fc=0, fc_old=0;
-
-   int test_patterns_generated = 0;
-   srand(time(0));
-   while (((fc==0)&(fc_old==0)) | ((fc-fc_old > 5)&(fault_list_drop.size() != 0))) {
-      test_patterns.clear();
-      test_patterns.push_back(PI);
-      for (int i = 0; i < Nnodes/10; i++) {     // todo change number of test_patterns generated in each iteration
-         for (int j = 0; j < PI.size(); j++) {
-            input_values.push_back(rand()%2);
-         }
-         test_patterns_generated++;
-         test_patterns.push_back(input_values);
-         input_values.clear();
-      }
-      
-      // write the fault list and test patterns to temp files inorder to pass them to PFS
-      ofstream output_file;
-      output_file.open("fault_list_temp.txt");
-      if ( output_file ) {
-         for (int i = 0; i < fault_list_drop.size(); i++) {
-            output_file << fault_list_drop[i].first << "@" << fault_list_drop[i].second << endl;
-         }
-      } else {
-         cout << "Couldn't create file\n";
-      }
-      output_file.close();
-      
-      int flag = 0;
-      output_file.open("test_pattern_temp.txt");
-      if ( output_file ) {
-         for (int i = 0; i < test_patterns.size(); i++) {
-            for (int j = 0; j < test_patterns[0].size(); j++) {
-               if (flag == 0) {
-                  output_file << test_patterns[i][j];
-                  flag = 1;
-               } else {
-                  output_file << "," << test_patterns[i][j];
-               }
-            }
-            output_file << endl;
-            flag = 0;
-         }
-      } else {
-         cout << "Couldn't create file\n";
-      }
-      output_file.close();
-
-      string pfs_arguments = "test_pattern_temp.txt fault_list_temp.txt detected_faults_temp.txt";
-      pfs(strdup(pfs_arguments.c_str()));
-
-      // read fault list
-      int i;
-      ifstream fault_file;
-      fault_file.open("detected_faults_temp.txt");
-      string fault_line, token;
-      if ( fault_file.is_open() ) {
-         while ( fault_file ) {
-            getline (fault_file, fault_line);   // read line from fault list file
-            stringstream X(fault_line);
-            i = 0;
-            while (getline(X, token, '@')) {
-               if (i == 0 ) {
-                  fault.first = (stoi(token));
-                  i = 1;
-               } else {
-                  fault.second = stoi(token);
-               }
-            }
-            if (fault_line != "") {
-               detected_faults.insert(fault);
-            }
-         }
-         fault_file.close();
-      }
-      else {
-         cout << "Couldn't open file\n";
-      }
+   string test_pattern_buf = circuitName + "_ATPG_patterns.txt";
 
-      // print test patterns to a file
-      flag = 0;
+   ofstream output_test_pattern_file;
+   output_test_pattern_file.open(test_pattern_buf);
+   // print test patterns to a file
+   size_t written = 0;
+   auto flush = [&]() {
       if ( output_test_pattern_file ) {
-         for (i = 1; i < test_patterns.size(); i++) {
-            for (int j = 0; j < test_patterns[0].size(); j++) {
-               if (flag == 0) {
-                  output_test_pattern_file << test_patterns[i][j];
-                  flag = 1;
-               } else {
-                  output_test_pattern_file << "," << test_patterns[i][j];
-               }
+         for (; written < job.patterns.size(); written++) {
+            for (int j = 0; j < job.patterns[written].size(); j++) {
+               output_test_pattern_file << (j ? "," : "") << job.patterns[written][j];
             }
             output_test_pattern_file << endl;
-            flag = 0;
          }
       } else {
          cout << "Couldn't create file\n";
       }
-
-      // calculate FC and update old FC
-      fc_old = fc;
-      fc = detected_faults.size()*100.0/fault_list.size();
-
-      // update fault_list_drop
-      for (auto element : detected_faults) {
-         fault_list_drop.erase(remove(fault_list_drop.begin(), fault_list_drop.end(), element), fault_list_drop.end());
-      }
-
-   }
-   cout << "Fault List size (after dropping): " << fault_list_drop.size() << endl;
-   cout<< "FC: " << fc << "%" << endl;
-   cout << "done with Random, starting ATPG_DET" << endl;
-   test_patterns.clear();
-   test_patterns.push_back(PI);
-   // podem
-   vector<int> test_pattern;
-   test_pattern.clear();
-   for (int i=0; i<fault_list_drop.size(); i++) {
-      string podem_arguments = to_string(fault_list_drop[i].first) + " " + to_string(fault_list_drop[i].second);
-      int x = podem(strdup(podem_arguments.c_str()));
-      if (x == 0) {  // if not timeout
-         for (int i = 0; i < Nnodes; i++) {
-
-            if (Node[i].fin == 0) {
-               if (Node[i].value == LOGIC_X) {
-                  Node[i].value = rand()%2;
-               } else if (Node[i].value == LOGIC_D) {
-                  Node[i].value = LOGIC_1;
-               } else if (Node[i].value == LOGIC_DBAR) {
-                  Node[i].value = LOGIC_0;
-               }
-               test_pattern.push_back(Node[i].value);
-            }
-         }
-         test_patterns.push_back(test_pattern);
-         test_pattern.clear();
-      }
+   };
+   if ( output_test_pattern_file ) {
+      for (int i = 0; i < PI.size(); i++) output_test_pattern_file << (i ? "," : "") << PI[i];
+      output_test_pattern_file << endl;
    }
+   flush();
 
-// -------------------------------------------------
-      // write the fault list and test patterns to temp files inorder to pass them to PFS
-      ofstream output_file;
-      output_file.open("fault_list_temp.txt");
-      if ( output_file ) {
-         for (int i = 0; i < fault_list_drop.size(); i++) {
-            output_file << fault_list_drop[i].first << "@" << fault_list_drop[i].second << endl;
-         }
-      } else {
-         cout << "Couldn't create file\n";
+   // random test generation
+   if (job.phase == ATPG_PHASE_RANDOM) {
+      vector<int> active;     // the representatives not detected yet
+      for (int i = 0; i < collapsed.size(); i++) {
+         if (faultStatus[collapsed[i]] == FAULT_UNDETECTED) active.push_back(collapsed[i]);
       }
-      output_file.close();
-      
-      flag = 0;
-      output_file.open("test_pattern_temp.txt");
-      if ( output_file ) {
-         for (int i = 0; i < test_patterns.size(); i++) {
-            for (int j = 0; j < test_patterns[0].size(); j++) {
-               if (flag == 0) {
-                  output_file << test_patterns[i][j];
-                  flag = 1;
-               } else {
-                  output_file << "," << test_patterns[i][j];
-               }
-            }
-            output_file << endl;
-            flag = 0;
+      vector<int> input_values(PI.size());
+      int batch = max(Nnodes/10, 1);     // patterns between two coverage checks
+      while (!active.empty() && (job.patterns.empty() || job.fc-job.fcOld > 5)) {
+         for (int i = 0; i < batch; i++) {
+            for (int j = 0; j < PI.size(); j++) input_values[j] = atpgRandom();
+            job.patterns.push_back(input_values);
+            pfsPattern(sim_order, input_values, active);
          }
-      } else {
-         cout << "Couldn't create file\n";
-      }
-      output_file.close();
+         flush();
 
-      string pfs_arguments = "test_pattern_temp.txt fault_list_temp.txt detected_faults_temp.txt";
-      pfs(strdup(pfs_arguments.c_str()));
-
-      // read fault list
-      int i;
-      ifstream fault_file;
-      fault_file.open("detected_faults_temp.txt");
-      string fault_line, token;
-      if ( fault_file.is_open() ) {
-         while ( fault_file ) {
-            getline (fault_file, fault_line);   // read line from fault list file
-            stringstream X(fault_line);
-            i = 0;
-            while (getline(X, token, '@')) {
-               if (i == 0 ) {
-                  fault.first = (stoi(token));
-                  i = 1;
-               } else {
-                  fault.second = stoi(token);
-               }
-            }
-            if (fault_line != "") {
-               detected_faults.insert(fault);
-            }
-         }
-         fault_file.close();
-      }
-      else {
-         cout << "Couldn't open file\n";
+         // calculate FC and update old FC
+         job.fcOld = job.fc;
+         job.fc = (collapsed.size() - active.size())*100.0/collapsed.size();
+         checkpoint();
       }
+      cout<< "FC: " << job.fc << "%" << endl;
+      cout << "done with Random, starting ATPG_DET" << endl;
+      job.phase = ATPG_PHASE_TARGETS;
+      job.faults = active;
+      job.next = 0;
+   }
 
-      // print test patterns to a file
-      flag = 0;
-      if ( output_test_pattern_file ) {
-         for (i = 1; i < test_patterns.size(); i++) {
-            for (int j = 0; j < test_patterns[0].size(); j++) {
-               if (flag == 0) {
-                  output_test_pattern_file << test_patterns[i][j];
-                  flag = 1;
-               } else {
-                  output_test_pattern_file << "," << test_patterns[i][j];
-               }
-            }
-            output_test_pattern_file << endl;
-            flag = 0;
-         }
-      } else {
-         cout << "Couldn't create file\n";
-      }
+   // deterministic test generation for job.faults[job.next ..]; every fault
+   // of the phase, and in the last phase every representative, stays in the
+   // active list, the committer drops the finished ones
+   auto schedule = [&]() {
+      int base = job.next;
+      vector<int> targets(job.faults.begin() + base, job.faults.end());
+      vector<int> active(job.faults);
+      if (job.phase == ATPG_PHASE_REST) active.insert(active.end(), collapsed.begin(), collapsed.end());
+      atpgCommitHook = [&](int f) {
+         job.next = base + f;
+         checkpoint();
+      };
+      atpgCommitDue = due;
+      atpgSchedule(alg, settings, targets, sim_order, active, job.patterns, job.wins, nthreads);
+      atpgCommitHook = nullptr;
+      atpgCommitDue = nullptr;
+      job.next = job.faults.size();
+   };
+   atpgCacheLoad(sim_order);
+   if (job.phase == ATPG_PHASE_TARGETS) {
+      schedule();
+
+      // a fault whose dominated representative got no test needs its own,
+      // unless a pattern already detects it
+      job.phase = ATPG_PHASE_REST;
+      job.faults = expandFaultStatus(fault_list);
+      for (int k = 0; k < job.patterns.size() && !job.faults.empty(); k++) pfsPattern(sim_order, job.patterns[k], job.faults);
+      job.next = 0;
+   }
+   schedule();
+   expandFaultStatus(fault_list);
+   atpgCacheSave();
+   flush();
+   remove(ckpt_file.c_str());
+
+   int num_detected = 0, num_untestable = 0, num_aborted = 0;
+   for (int i = 0; i < fault_list.size(); i++) {
+      int st = faultStatus[fault_list[i]];
+      num_detected += (st == FAULT_DETECTED);
+      num_untestable += (st == FAULT_UNTESTABLE);
+      num_aborted += (st == FAULT_ABORTED);
+   }
 
       // done with atpg -report
    const sec duration = std::chrono::system_clock::now() - before;
@@ -3256,8 +5726,21 @@ int atpg(char *cp) {
    output_report.open(atpg_det_output_report);
    if ( output_report ) {
       output_report << "Circuit: " << circuitName << endl;
-      output_report << "Fault Coverage: " << fixed << setprecision(2) << detected_faults.size()*100.0/fault_list.size() << "%" << endl;
-      output_report << "Time: " << duration.count()  << " seconds" << endl;
+      output_report << "Fault Coverage: " << fixed << setprecision(2) << num_detected*100.0/fault_list.size() << "%" << endl;
+      output_report << "Detected: " << num_detected << endl;
+      output_report << "Untestable: " << num_untestable << endl;
+      output_report << "Aborted: " << num_aborted << endl;
+      output_report << "Faults: " << fault_list.size() << " (" << collapsed.size() << " targeted after collapsing)" << endl;
+      output_report << "Backtrack limit: " << settings.backtracks << endl;
+      output_report << "Threads: " << nthreads << endl;
+      output_report << "Seed: " << job.seed << endl;
+      output_report << "Compaction tries: " << settings.compactTries << endl;
+      if (!atpgCacheFile.empty()) output_report << "Cache hits: " << atpgCacheHits << endl;
+      if (alg == "PORTFOLIO") {
+         for (int e = 0; e < ATPG_PORTFOLIO_SIZE; e++) output_report << "Wins " << atpgPortfolio[e] << ": " << job.wins[e] << endl;
+      }
+      if (resumed) output_report << "Resumed: after " << prior << " seconds" << endl;
+      output_report << "Time: " << prior + duration.count()  << " seconds" << endl;
       output_report.close();
    } else {
       cout << "Couldn't create file\n";
@@ -3270,6 +5753,72 @@ int atpg(char *cp) {
    return 0;
 }
 
+int atpg(char *cp) {
+   // time
+   // read
+   // lev
+   // rfl
+   // random test generation
+   // calculate fc after every Nnodes/10 patterns
+   // if difference in fc is less than 10%
+   // -- switch to podem
+      // for all faults
+      // --podem/dalg
+      // --add pattern
+   // print patterns
+   // logic for fc
+   // report
+
+   char circuit_name[MAXLINE], alg_name[MAXLINE], backtrack_buf[MAXLINE], time_buf[MAXLINE], threads_buf[MAXLINE], seed_buf[MAXLINE], compact_buf[MAXLINE], interval_buf[MAXLINE];
+   int nargs = sscanf(cp, "%s %s %s %s %s %s %s %s", circuit_name, alg_name, backtrack_buf, time_buf, threads_buf, seed_buf, compact_buf, interval_buf);
+   // optional search limits per fault, the number of threads generating tests
+   // (0 = all cores), the seed of the random patterns and the X fill, the
+   // secondary faults tried per pattern by dynamic compaction (0 = off), and
+   // the seconds between checkpoints (0 = off)
+   if (nargs < 2) {
+      cout << "invalid argument" << endl;
+      return 1;
+   }
+   AtpgCheckpoint job;
+   job.circuit = circuit_name;
+   job.alg = alg_name;
+   transform(job.alg.begin(), job.alg.end(), job.alg.begin(), ::toupper);
+   if (!atpgEngineKnown(job.alg)) {
+      cout << "invalid argument" << endl;
+      return 1;
+   }
+   job.backtracks = (nargs >= 3) ? stoi(backtrack_buf) : ATPG_BACKTRACK_LIMIT;
+   job.seconds = (nargs >= 4) ? stod(time_buf) : ATPG_TIME_LIMIT;
+   job.nthreads = (nargs >= 5) ? stoi(threads_buf) : 1;
+   job.seed = (nargs >= 6) ? stoul(seed_buf) : time(0);
+   job.compactTries = (nargs >= 7) ? stoi(compact_buf) : ATPG_COMPACT_TRIES;
+   job.interval = (nargs >= 8) ? stod(interval_buf) : 60;
+   if (job.nthreads <= 0) job.nthreads = max((int) thread::hardware_concurrency(), 1);
+   return atpgRun(job, "", false);
+}
+
+/*-----------------------------------------------------------------------
+input: checkpoint file, optional number of threads (0 = all cores)
+output: the patterns and report of the interrupted ATPG run
+called by: main
+description:
+  Continues an ATPG run from its last checkpoint, with the settings it was
+  started with. The number of threads can change: the patterns do not
+  depend on it.
+-----------------------------------------------------------------------*/
+int resume(char *cp) {
+   char file_buf[MAXLINE], threads_buf[MAXLINE];
+   int nargs = sscanf(cp, "%s %s", file_buf, threads_buf);
+   AtpgCheckpoint job;
+   if (nargs < 1 || !atpgCheckpointLoad(file_buf, job)) {
+      cout << "Couldn't read checkpoint\n";
+      return 1;
+   }
+   if (nargs >= 2) job.nthreads = stoi(threads_buf);
+   if (job.nthreads <= 0) job.nthreads = max((int) thread::hardware_concurrency(), 1);
+   return atpgRun(job, file_buf, true);
+}
+
 /*-----------------------------------------------------------------------
 input: nothing
 output: nothing
@@ -3296,6 +5845,30 @@ int help(char *cp)
    printf("RTG - ");
    printf("generates random test patterns and calculates FC\n");
    printf("> rtg ntot nTFCR test_patterns.out fc.out\n");
+   printf("DFS - ");
+   printf("performs deductive fault simulation\n");
+   printf("> dfs P_D_FS/input/c17_test_in.txt c17.out\n");
+   printf("PODEM, FAN, SAT, DALG - ");
+   printf("generate a test for one stuck-at fault (DALG takes an optional recursive learning depth)\n");
+   printf("> podem 22 0\n");
+   printf("ATPG_DET - ");
+   printf("deterministic test generation for the reduced fault list, ALG is PODEM, FAN, SAT, DALG or PORTFOLIO\n");
+   printf("> atpg_det c17.ckt ALG [backtracks] [seconds] [depth] [threads] [seed] [compaction tries]\n");
+   printf("ATPG - ");
+   printf("random patterns, then deterministic test generation for the faults left\n");
+   printf("> atpg c17.ckt ALG [backtracks] [seconds] [threads] [seed] [compaction tries] [checkpoint seconds]\n");
+   printf("COMPACT - ");
+   printf("static compaction of a pattern file (X allowed) for a fault list, with the same coverage\n");
+   printf("> compact c17_DALG_ATPG_patterns.txt RFL/c17_rfl.txt c17_compact.txt [random passes]\n");
+   printf("COLLAPSE - ");
+   printf("equivalence and dominance collapsed fault list, with an optional representative->members map\n");
+   printf("> collapse c17_collapsed.txt [c17_collapse_map.txt]\n");
+   printf("CACHE - ");
+   printf("reuse ATPG_DET/ATPG results of earlier runs on faults whose cone did not change (OFF to stop)\n");
+   printf("> cache c17_atpg_cache.txt\n");
+   printf("RESUME - ");
+   printf("continue an ATPG run from its checkpoint, optionally on another number of threads\n");
+   printf("> resume c17_ATPG_checkpoint.bin [threads]\n");
    printf("HELP - ");
    printf("print this help information\n");
    printf("QUIT - ");
@@ -3364,6 +5937,7 @@ void allocate()
    for(i = 0; i<Nnodes; i++) {
       Node[i].indx = i;
       Node[i].fin = Node[i].fout = 0;
+      Node[i].po = 0;
    }
 }
 